@@ -1,11 +1,19 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <sys/mman.h>
 
-// 
+#include "sk6812.h"
+
+//
 /* -------- Key Resources --------
 - RK3568 TRM Part I V1.3
 - RK3568 TRM Part II V1.1 (Can't find 1.3)
@@ -13,20 +21,38 @@
 - Firefly ROC-RK3568-PC PWM examples (pwm-firefly.c)
 - Raspberry Pi 4 DMA Examples (specifically for SK6812 or ws281x LEDSTRIPS -> see rpi_ws281x library for full, quality RPi implementation)
 
-TODO 
+TODO
 - Add the RPi DMA one
 - Additional useful sources
 */
 
+/*
+    SK6812 REAL-TIME USERSPACE MMIO DRIVER
+    For boards where the kernel module can't be loaded. The PWM block is
+    mapped from /dev/mem and a SCHED_FIFO thread, pinned to an isolated CPU
+    with all memory locked and prefaulted, writes one duty word per period,
+    pacing itself from the channel's counter register. Frames are encoded
+    exactly as the kernel driver does (sk6812.h).
+
+    Registers go through a pluggable backend: "devmem" for the hardware, or
+    "sim", a memfd-backed register file whose counter runs off
+    CLOCK_MONOTONIC and which records every duty write, so the engine can be
+    exercised and checked on any Linux host.
+
+    Usage: direct_pwm_access_rk3568 [-s] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB
+        boot with isolcpus=<cpu> for the pinned CPU to be undisturbed
+*/
+
 // -------- Debug --------
 #define DEBUG   1       // Print non-zero print debug
 
 // -------- Register Definitions --------
 #define DMAC0_NS                0xFE530000 // DMA Base address (placeholder, use your actual)
-#define PWM2_BASE               0xFE6F0000 
-#define PWM2_PERIOD_OFFSET      0x0024 
+#define PWM2_BASE               0xFE6F0000
+#define PWM2_CNT_OFFSET         0x0020
+#define PWM2_PERIOD_OFFSET      0x0024
 #define PWM2_DUTY_OFFSET        0x0028
-#define PWM2_CTRL_OFFSET        0x002C 
+#define PWM2_CTRL_OFFSET        0x002C
 
 // -------- Register Configuration --------
 #define PWM_CTRL_TIMER_EN	    (1 << 0)
@@ -44,31 +70,22 @@ TODO
 #define PWM_LOCK_EN		        (1 << 6)
 #define PWM_LP_DISABLE		    (0 << 8)
 
-// TODO delete, running in continuous mode
-#define PWM_ONESHOT_COUNT_SHIFT 24
-#define PWM_ONESHOT_COUNT_MASK	(0xff << PWM_ONESHOT_COUNT_SHIFT)
-#define PWM_ONESHOT_COUNT_MAX	256
-
-#define PWM_REG_INTSTS(n)	    ((3 - (n)) * 0x10 + 0x10)
-#define PWM_REG_INT_EN(n)	    ((3 - (n)) * 0x10 + 0x14)
-
-#define PWM_CH_INT(n)		    BIT(n)
-
 // -------- SK6812 Specification --------
-#define LEDS                    57           // Number of LEDs
-#define T0H                     300          // Duty cycle high / low for 0
-#define T0L                     900 
-#define T1H                     600          // Duty cycle high / low for 1
-#define T1L                     600
-#define FPWM                    (T0H + T0L)  // PWM frequency (period)
-#define RST                     50000        // min. reset value
+#define LEDS                    57           // Default number of LEDs
+#define PWM_CLK_HZ              24000000     // Default PWM clock, override with -r
+#define PWM_PRESCALER           1
+
+// -------- Real-Time --------
+#define RT_PRIORITY             80           // SCHED_FIFO priority
+#define PREFAULT_STACK          (64 * 1024)  // Stack touched before going real-time
+#define SPIN_LIMIT              100000       // Counter polls before declaring the PWM stalled
 
 // -------- Memory Macros --------
 #define PAGE_SIZE         0x1000  // Size of memory page
 #define PAGE_ROUNDUP(n)   ((n)%PAGE_SIZE==0 ? (n) : ((n)+PAGE_SIZE)&~(PAGE_SIZE-1)) // Round up to nearest page
 
 // ----- MGMT -----
-void FAIL(const char *msg) 
+void FAIL(const char *msg)
 {
     printf("%s\n", msg);
     exit(1);
@@ -76,7 +93,7 @@ void FAIL(const char *msg)
 
 // ----- VIRTUAL MEMORY -----
 // Get virtual memory segment for peripheral regs or physical mem
-void *map_segment(void *addr, int size)
+void *map_segment(uintptr_t addr, int size)
 {
   int fd;
   void *mem;
@@ -86,13 +103,14 @@ void *map_segment(void *addr, int size)
   if ((fd = open ("/dev/mem", O_RDWR|O_SYNC)) < 0)
     FAIL("Error: can't open /dev/mem, run using sudo\n");
 
-  /* 
+  /*
   mmap takes a physical address (the peripheral in our case) and opens a window
   in virtual memory that this program can access; any R/W to the window is automatically
-  redircted to the peripheral  
+  redircted to the peripheral. MAP_POPULATE prefaults the page tables so the
+  first register access from the real-time loop doesn't take a fault.
   */
 
-  mem = mmap(0, size, PROT_WRITE|PROT_READ, MAP_SHARED, fd, (uint32_t)addr);
+  mem = mmap(0, size, PROT_WRITE|PROT_READ, MAP_SHARED|MAP_POPULATE, fd, addr);
   close(fd);
 
 #if DEBUG
@@ -111,147 +129,336 @@ void unmap_segment(void *mem, int size)
     munmap(mem, PAGE_ROUNDUP(size));
 }
 
-uint32_t set_pwm_duty_cycle_ns(void *pwm_regs, uint32_t duration_ns) 
+// ----- REGISTER BACKENDS -----
+struct reg_backend
+{
+    const char *name;
+    volatile uint32_t *regs;        // register window, PWM2 offsets
+    uint32_t (*read)(struct reg_backend *rb, uint32_t offset);
+    void (*write)(struct reg_backend *rb, uint32_t offset, uint32_t value);
+    void (*close)(struct reg_backend *rb);
+
+    // sim only
+    struct timespec start;
+    uint32_t clk_hz;
+    uint32_t *trace;                // every duty write, in order
+    size_t trace_len;
+    size_t trace_cap;
+};
+
+uint32_t devmem_read(struct reg_backend *rb, uint32_t offset)
 {
-    uint32_t *duty_reg = (uint32_t *)pwm_regs + (PWM2_DUTY_OFFSET / sizeof(uint32_t));
-    // TODO: what are PWM peripheral register units? ns?
-    *duty_reg = duration_ns; 
-    return *duty_reg;
+    return rb->regs[offset / sizeof(uint32_t)];
 }
 
-// ----- PROGRAM -----
-int main() 
+void devmem_write(struct reg_backend *rb, uint32_t offset, uint32_t value)
 {
-    fprintf(stdout, "[LIGHT] Using physical address 0x%x\n", PWM2_BASE);
-    int fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if (fd < 0)
-    {
-        printf("[LIGHT] ERROR: Failed to open /dev/mem\n");
-    }
+    rb->regs[offset / sizeof(uint32_t)] = value;
+}
 
-    void *pwm_regs = mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, PWM2_BASE);
-    if (pwm_regs == NULL) 
-    {
-        printf("[LIGHT] ERROR: Failed to mmap() PWM physical register address to virtual memory\n");
-        return -1;
-    }
-    else 
-    { 
-        printf("[LIGHT] PWM register mapped at %p\n", pwm_regs); // Print mapped virtual mem addr
-    }
-    close(fd); // can close file descriptor without invalidating the mapping (see mmap() man page)
-    
-    fprintf(stdout, "TP0");
+void devmem_close(struct reg_backend *rb)
+{
+    unmap_segment((void *)rb->regs, PAGE_SIZE);
+}
+
+void devmem_open(struct reg_backend *rb)
+{
+    memset(rb, 0, sizeof(*rb));
+    rb->name = "devmem";
+    rb->regs = map_segment(PWM2_BASE, PAGE_SIZE);
+    rb->read = devmem_read;
+    rb->write = devmem_write;
+    rb->close = devmem_close;
+}
 
-    // assume shortest possible period for continuous mode
-    uint32_t duty_reg_val = set_pwm_duty_cycle_ns(pwm_regs, T0H);
-    
-    uint32_t *period_reg = (uint32_t *)pwm_regs + (PWM2_PERIOD_OFFSET / sizeof(uint32_t));
-    *period_reg = T0H + T0L;
+// The simulated counter free-runs at clk_hz and wraps at the period register
+uint32_t sim_read(struct reg_backend *rb, uint32_t offset)
+{
+    struct timespec now;
+    uint64_t ns, ticks;
+    uint32_t period;
 
-    fprintf(stdout, "TP1");
+    if (offset != PWM2_CNT_OFFSET)
+        return rb->regs[offset / sizeof(uint32_t)];
 
-    printf("Set PWM2 period (%d) with bus value %d\n", T0H + T0L, *period_reg);
-    printf("Set PWM2 duty cycle (%d) with bus value %u\n", T0H, duty_reg_val);
+    period = rb->regs[PWM2_PERIOD_OFFSET / sizeof(uint32_t)];
+    if (period == 0 || !(rb->regs[PWM2_CTRL_OFFSET / sizeof(uint32_t)] & PWM_ENABLE))
+        return 0;
 
-    uint32_t *ctrl_reg = (uint32_t *)pwm_regs + (PWM2_CTRL_OFFSET / sizeof(uint32_t));
-    *ctrl_reg |= PWM_ENABLE;
-    uint32_t ctrl_reg_value = *ctrl_reg;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (uint64_t)(now.tv_sec - rb->start.tv_sec) * 1000000000ULL + now.tv_nsec - rb->start.tv_nsec;
+    ticks = ns * rb->clk_hz / 1000000000ULL;
+    return ticks % period;
+}
 
-    printf("TP2");
+void sim_write(struct reg_backend *rb, uint32_t offset, uint32_t value)
+{
+    if (offset == PWM2_DUTY_OFFSET && rb->trace_len < rb->trace_cap)
+        rb->trace[rb->trace_len++] = value;
+    rb->regs[offset / sizeof(uint32_t)] = value;
+}
 
-    if (ctrl_reg_value & PWM_ENABLE) 
-    {
-        printf("[LIGHT] PWM2 Enable bus value correct\n");
-    } 
-    else 
-    {
-        printf("[LIGHT] PWM2 Enable bus value incorrect\n");
-    }
+void sim_close(struct reg_backend *rb)
+{
+    munmap((void *)rb->regs, PAGE_SIZE);
+    free(rb->trace);
 }
 
-// ----- PWM ----- 
-void pwm_configure(int period, int duty_cycle, void* pwm_regs) 
+void sim_open(struct reg_backend *rb, uint32_t clk_hz, size_t trace_cap)
 {
-    printf("Writing period value: %d\n", period);
-    printf("Writing duty cycle value: %d\n", duty_cycle);
+    void *mem;
+    int fd;
+
+    memset(rb, 0, sizeof(*rb));
+    if ((fd = memfd_create("pwm2-regs", MFD_CLOEXEC)) < 0)
+        FAIL("Error: memfd_create failed\n");
+    if (ftruncate(fd, PAGE_SIZE) < 0)
+        FAIL("Error: can't size simulated register file\n");
+    mem = mmap(0, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        FAIL("Error: can't map simulated register file\n");
+
+    rb->name = "sim";
+    rb->regs = mem;
+    rb->read = sim_read;
+    rb->write = sim_write;
+    rb->close = sim_close;
+    rb->clk_hz = clk_hz;
+    rb->trace_cap = trace_cap;
+    if ((rb->trace = calloc(trace_cap, sizeof(uint32_t))) == NULL)
+        FAIL("Error: can't allocate duty trace\n");
+    clock_gettime(CLOCK_MONOTONIC, &rb->start);
+}
 
-    uint32_t *pwm2_regs = (uint32_t*)pwm_regs;
-    pwm2_regs[PWM2_PERIOD_OFFSET / sizeof(uint32_t)] = period;
-    pwm2_regs[PWM2_DUTY_OFFSET / sizeof(uint32_t)] = duty_cycle;
+// ----- REAL-TIME -----
+// Touch the stack we'll use so no page faults happen once real-time
+__attribute__((noinline)) void prefault_stack(void)
+{
+    volatile unsigned char stack[PREFAULT_STACK];
 
-    // Calculate addresses
-    uint32_t *period_reg_addr = pwm2_regs + (PWM2_PERIOD_OFFSET / sizeof(uint32_t));
-    uint32_t *duty_reg_addr = pwm2_regs + (PWM2_DUTY_OFFSET / sizeof(uint32_t));
+    memset((void *)stack, 0, sizeof(stack));
+}
 
-    printf("PWM2 period register at %p, value: %u\n", period_reg_addr, *period_reg_addr);
-    printf("PWM2 duty cycle register at %p, value: %u\n", duty_reg_addr, *duty_reg_addr);
+void rt_setup(int cpu, int priority)
+{
+    struct sched_param param = { .sched_priority = priority };
+    cpu_set_t cpus;
 
-    /*
-    volatile uint32_t *pwm_registers = (volatile uint32_t *)(mapped_base + register_offset);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        perror("[LIGHT] WARNING: mlockall");
+    prefault_stack();
+
+    if (cpu >= 0)
+    {
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+            perror("[LIGHT] WARNING: sched_setaffinity");
+    }
+
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+        perror("[LIGHT] WARNING: SCHED_FIFO");
+}
 
-    // -------- Configuration (Based on Usage Flow) --------
+// ----- PWM -----
+uint32_t ns_to_ticks(uint32_t ns, uint32_t clk_hz)
+{
+    return ((uint64_t)clk_hz * ns + PWM_PRESCALER * 500000000ULL) / (PWM_PRESCALER * 1000000000ULL);
+}
 
-    // 1. Disable PWM channel
-    pwm_registers[PWM2_CTRL_OFFSET / 4] &= ~PWM_CTRL_TIMER_EN;  
+uint32_t ticks_to_ns(uint32_t ticks, uint32_t clk_hz)
+{
+    return ((uint64_t)ticks * PWM_PRESCALER * 1000000000ULL + clk_hz / 2) / clk_hz;
+}
 
-    // ... (Prescale, Clock selection -  not provided in usage flow)
+// Time the line is high for one period of @duty, given the channel's ctrl
+uint32_t duty_high_ns(uint32_t ctrl, uint32_t period, uint32_t duty, uint32_t clk_hz)
+{
+    if (ctrl & PWM_DUTY_POSITIVE)
+        return ticks_to_ns(duty, clk_hz);
+    return ticks_to_ns(period - duty, clk_hz);
+}
 
-    // 3. Output mode, Polarity (replace with your choices)
-    pwm_registers[PWM2_CTRL_OFFSET / 4] &= ~PWM_POLARITY_MASK; // Clear existing polarity
-    pwm_registers[PWM2_CTRL_OFFSET / 4] |= PWM_DUTY_POSITIVE | PWM_INACTIVE_NEGATIVE; 
+void pwm_configure(struct reg_backend *rb, uint32_t period, uint32_t duty_cycle)
+{
+    uint32_t ctrl = rb->read(rb, PWM2_CTRL_OFFSET);
 
-    // 4. For one-shot mode, configure PWM_PWMx_CTRL.rpt (omitted for continuous)
+    // Disable, set polarity and continuous mode, load period and duty, enable
+    ctrl &= ~(PWM_ENABLE | PWM_POLARITY_MASK | PWM_OUTPUT_CENTER | PWM_LOCK_EN);
+    rb->write(rb, PWM2_CTRL_OFFSET, ctrl);
 
-    // 5. Choose continuous mode
-    pwm_registers[PWM2_CTRL_OFFSET / 4] |= PWM_CONTINUOUS;  
+    ctrl |= PWM_DUTY_POSITIVE | PWM_INACTIVE_NEGATIVE | PWM_OUTPUT_LEFT | PWM_LP_DISABLE | PWM_CONTINUOUS;
+    rb->write(rb, PWM2_PERIOD_OFFSET, period);
+    rb->write(rb, PWM2_DUTY_OFFSET, duty_cycle);
+    rb->write(rb, PWM2_CTRL_OFFSET, ctrl);
 
-    // 6. (Omitted - Assumed interrupts not needed) 
-    // 7. (Omitted - Assumed disabled by default)
+#if DEBUG
+    printf("PWM2 period %u duty %u ctrl 0x%08x\n", period, duty_cycle, ctrl);
+#endif
+}
 
-    // -------- Set Period and Duty Cycle --------
-    // You'll need to calculate register values based on your clock and desired timing
+void pwm_start(struct reg_backend *rb)
+{
+    rb->write(rb, PWM2_CTRL_OFFSET, rb->read(rb, PWM2_CTRL_OFFSET) | PWM_ENABLE);
+}
 
-    pwm_registers[PWM2_PERIOD_OFFSET / 4] = ; 
-    pwm_registers[PWM2_DUTY_OFFSET / 4] = ; 
+void pwm_stop(struct reg_backend *rb)
+{
+    rb->write(rb, PWM2_CTRL_OFFSET, rb->read(rb, PWM2_CTRL_OFFSET) & ~PWM_ENABLE);
+}
 
-    // -------- Enable the PWM --------
-    pwm_registers[PWM2_CTRL_OFFSET / 4] |= PWM_CTRL_OUTPUT_EN | PWM_CTRL_TIMER_EN ; 
-    */
+int pwm_enabled(struct reg_backend *rb)
+{
+    return (rb->read(rb, PWM2_CTRL_OFFSET) & PWM_ENABLE) != 0;
 }
 
-void pwm_start(void* pwm_regs) 
+/*
+    Send one frame. A duty write takes effect at the next period boundary,
+    so after each write we spin on the counter until it wraps, then write
+    the next word: one word per period, paced by the hardware itself.
+    Returns -1 if the counter stops moving.
+*/
+int send_frame(struct reg_backend *rb, const uint32_t *duty, size_t len)
 {
-    uint32_t *pwm2_regs = (uint32_t*)pwm_regs;
-    pwm2_regs[PWM2_CTRL_OFFSET / sizeof(uint32_t)] |= PWM_ENABLE;
-    printf("Enabled PWM with pwm2_regs value\n");
+    uint32_t prev, cnt;
+    long spins;
 
-    for (int i = 0; i < (sizeof (pwm2_regs) / sizeof(pwm2_regs[0])); i++) 
+    prev = rb->read(rb, PWM2_CNT_OFFSET);
+    for (size_t k = 0; k < len; ++k)
     {
-        printf("%lf ", pwm2_regs[i]);
+        rb->write(rb, PWM2_DUTY_OFFSET, duty[k]);
+
+        for (spins = 0; ; ++spins)
+        {
+            cnt = rb->read(rb, PWM2_CNT_OFFSET);
+            if (cnt < prev)
+                break;
+            prev = cnt;
+            if (spins > SPIN_LIMIT)
+                return -1;
+        }
+        prev = cnt;
     }
 
-    printf("\n");
+    // Hold the line low for the reset so the frame latches
+    rb->write(rb, PWM2_DUTY_OFFSET, 0);
+    struct timespec rst = { 0, 2 * SK6812_RST };
+    nanosleep(&rst, NULL);
 
+    return 0;
 }
 
-void pwm_stop(void* pwm_regs) 
+// ----- PROGRAM -----
+int main(int argc, char **argv)
 {
-    uint32_t *pwm2_regs = (uint32_t*)pwm_regs;
-    pwm2_regs[PWM2_CTRL_OFFSET / sizeof(uint32_t)] &= ~PWM_ENABLE;
-}
+    struct reg_backend rb;
+    int sim = 0, cpu = -1, priority = RT_PRIORITY, leds = LEDS, frames = 1;
+    uint32_t clk_hz = PWM_CLK_HZ, d0, d1, rgb;
+    uint8_t *pixels;
+    uint32_t *duty;
+    size_t len;
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "sc:p:r:n:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': sim = 1; break;
+        case 'c': cpu = atoi(optarg); break;
+        case 'p': priority = atoi(optarg); break;
+        case 'r': clk_hz = strtoul(optarg, NULL, 0); break;
+        case 'n': leds = atoi(optarg); break;
+        case 'f': frames = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-s] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || leds <= 0 || frames <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-s] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB\n", argv[0]);
+        return 1;
+    }
+    rgb = strtoul(argv[optind], NULL, 16);
+
+    /* FILL AND ENCODE THE FRAME, the same way the kernel driver does */
+    len = (size_t)leds * SK6812_LED_BITS;
+    pixels = malloc(leds * 3);
+    duty = malloc(len * sizeof(uint32_t));
+    if (pixels == NULL || duty == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate frame");
+    for (int i = 0; i < leds; ++i)
+    {
+        pixels[i * 3 + 0] = rgb >> 16;
+        pixels[i * 3 + 1] = rgb >> 8;
+        pixels[i * 3 + 2] = rgb;
+    }
+    // Positive duty polarity: the duty word is the high time of the bit
+    d0 = ns_to_ticks(SK6812_T0H, clk_hz);
+    d1 = ns_to_ticks(SK6812_T1H, clk_hz);
+    sk6812_encode_duty(pixels, leds, d0, d1, duty);
 
-int pwm_enabled(void *pwm_regs) 
-{
-    uint32_t *pwm2_regs = (uint32_t *)pwm_regs;
-    uint32_t ctrl_reg_value = pwm2_regs[PWM2_CTRL_OFFSET / sizeof(uint32_t)];
+    if (sim)
+        sim_open(&rb, clk_hz, (len + 1) * frames + 1);
+    else
+        devmem_open(&rb);
+    fprintf(stdout, "[LIGHT] %s registers, %d LEDs, PWM clock %u Hz\n", rb.name, leds, clk_hz);
+
+    /* GO REAL-TIME, everything is allocated and mapped by now */
+    rt_setup(cpu, priority);
 
-    if ((ctrl_reg_value & PWM_ENABLE) != 0) 
+    pwm_configure(&rb, ns_to_ticks(SK6812_FPWM, clk_hz), 0);
+    pwm_start(&rb);
+
+    for (int f = 0; f < frames && ret == 0; ++f)
     {
-        return 1;
-    } 
-    else 
+        if (send_frame(&rb, duty, len) < 0)
+        {
+            printf("[LIGHT] ERROR: PWM counter stalled, is the channel running?\n");
+            ret = 1;
+        }
+    }
+
+    pwm_stop(&rb);
+
+    /*
+        The simulated register file recorded every duty write. Check what
+        each one puts on the line, not just that it matches our own
+        encoding: every bit's high time against the datasheet, and the
+        latch held low.
+    */
+    if (sim && ret == 0)
     {
-        return 0;
+        uint32_t ctrl = rb.read(&rb, PWM2_CTRL_OFFSET);
+        uint32_t period = rb.read(&rb, PWM2_PERIOD_OFFSET);
+
+        for (int f = 0; f < frames && ret == 0; ++f)
+        {
+            const uint32_t *trace = rb.trace + 1 + f * (len + 1); // skip configure and latch writes
+            for (size_t k = 0; k < len; ++k)
+            {
+                uint32_t want = sk6812_wire_bit(pixels, k) ? SK6812_T1H : SK6812_T0H;
+                uint32_t high = duty_high_ns(ctrl, period, trace[k], clk_hz);
+                if (high + SK6812_TOL < want || high > want + SK6812_TOL)
+                {
+                    printf("[LIGHT] sim: frame %d bit %zu high for %u ns, want %u\n", f, k, high, want);
+                    ret = 1;
+                    break;
+                }
+            }
+            if (ret == 0 && duty_high_ns(ctrl, period, trace[len], clk_hz) != 0)
+            {
+                printf("[LIGHT] sim: frame %d latch does not hold the line low\n", f);
+                ret = 1;
+            }
+        }
+        if (ret == 0)
+            printf("[LIGHT] sim: %d frame(s), all %zu bits within %d ns of T0H/T1H\n", frames, len * frames, SK6812_TOL);
     }
+
+    rb.close(&rb);
+    free(pixels);
+    free(duty);
+    return ret;
 }
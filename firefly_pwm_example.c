@@ -25,9 +25,17 @@
 #include <linux/gpio.h>
 #include <linux/of_gpio.h>
 #include <linux/init.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/string.h>
 
 #define SYS_DEV_CONFIG 1
 
+#define RAMP_STEP_NS		(1 * NSEC_PER_MSEC)	/* duty recomputed every step */
+#define RAMP_MS_MAX		(60 * 60 * 1000)
+#define RAMP_EXP_OCTAVES	8	/* exp curve spans 2^8 : 1 */
+
 static int gval = 0;
 struct firefly_pwm_data {
 	struct pwm_chip *chip;
@@ -42,6 +50,118 @@ struct firefly_pwm_data {
 };
 struct firefly_pwm_data g_firefly_pdata;
 
+/*
+ * Duty ramps: write ramp_target and the duty moves there from its current
+ * value over ramp_ms, along ramp_curve. An hrtimer works out the duty every
+ * step (or every PWM period, if longer) and hands it to a FIFO kthread,
+ * which applies it only if it changed; pwm_config() may sleep, so it can't
+ * be called from the timer. Writing pwm directly stops a running ramp.
+ */
+enum {
+	RAMP_LINEAR,
+	RAMP_EXP,
+};
+
+static const char * const ramp_curves[] = {
+	[RAMP_LINEAR] = "linear",
+	[RAMP_EXP] = "exp",
+};
+
+struct firefly_pwm_ramp {
+	struct hrtimer timer;
+	struct kthread_worker *worker;
+	struct kthread_work apply;
+	struct mutex lock;		/* pwm_config() and gval */
+	ktime_t start;
+	u64 step_ns;
+	u64 duration_ns;
+	unsigned int from;
+	unsigned int to;
+	unsigned int duty;		/* latest from the timer */
+	unsigned int ms;
+	unsigned int curve;
+};
+static struct firefly_pwm_ramp ramp = {
+	.ms = 1000,
+	.curve = RAMP_LINEAR,
+};
+
+/*
+ * Progress @x of the ramp (0 to 65536) along the curve, same scale. The
+ * exp curve is (2^(8x) - 1) / 255, even steps in perceived brightness
+ * or fan noise; 2^frac comes from a quadratic fit, within about 1%.
+ */
+static unsigned int firefly_pwm_ramp_curve(unsigned int x)
+{
+	u32 e, f, v;
+
+	if (ramp.curve == RAMP_LINEAR)
+		return x;
+
+	e = x * RAMP_EXP_OCTAVES;
+	f = e & 0xffff;
+	v = 65536 + ((f * (43019 + ((22517 * f) >> 16))) >> 16);
+	v <<= e >> 16;
+
+	return (v - 65536) / 255;
+}
+
+static enum hrtimer_restart firefly_pwm_ramp_step(struct hrtimer *timer)
+{
+	u64 elapsed = ktime_to_ns(ktime_sub(ktime_get(), ramp.start));
+	unsigned int x, duty;
+	bool done = elapsed >= ramp.duration_ns;
+
+	x = done ? 65536 : div64_u64(elapsed << 16, ramp.duration_ns);
+
+	/* downwards the curve is mirrored, exp falls fast then settles */
+	if (ramp.to >= ramp.from)
+		duty = ramp.from + (((u64)(ramp.to - ramp.from) *
+				     firefly_pwm_ramp_curve(x)) >> 16);
+	else
+		duty = ramp.to + (((u64)(ramp.from - ramp.to) *
+				   firefly_pwm_ramp_curve(65536 - x)) >> 16);
+
+	if (duty != ramp.duty) {
+		WRITE_ONCE(ramp.duty, duty);
+		kthread_queue_work(ramp.worker, &ramp.apply);
+	}
+
+	if (done)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, ns_to_ktime(ramp.step_ns));
+	return HRTIMER_RESTART;
+}
+
+static void firefly_pwm_ramp_apply(struct kthread_work *work)
+{
+	unsigned int duty = READ_ONCE(ramp.duty);
+
+	mutex_lock(&ramp.lock);
+	if (duty != gval) {
+		pwm_config(g_firefly_pdata.pwm, duty, g_firefly_pdata.pwm_period_ns);
+		gval = duty;
+	}
+	mutex_unlock(&ramp.lock);
+}
+
+static void firefly_pwm_ramp_stop(void)
+{
+	hrtimer_cancel(&ramp.timer);
+	kthread_flush_work(&ramp.apply);
+}
+
+static unsigned int firefly_pwm_clamp(unsigned long state)
+{
+	if (state > g_firefly_pdata.max_period)
+		state = g_firefly_pdata.max_period;
+	else if (state < g_firefly_pdata.min_period)
+		state = g_firefly_pdata.min_period;
+
+	return state;
+}
+
 #ifdef SYS_DEV_CONFIG
 static ssize_t firefly_pwm_store(struct device *dev, \
 		struct device_attribute *attr, const char *buf,size_t count)
@@ -49,18 +169,18 @@ static ssize_t firefly_pwm_store(struct device *dev, \
 	unsigned long state;
 	int c,ret;
 	ret = kstrtoul(buf, 10, &state);
-	if (state > g_firefly_pdata.max_period)
-		state = g_firefly_pdata.max_period;
-	else if (state < g_firefly_pdata.min_period)
-		state = g_firefly_pdata.min_period;
-	c = state;
 	if (ret)
 		return ret;
+	c = firefly_pwm_clamp(state);
 
+	firefly_pwm_ramp_stop();
+
+	mutex_lock(&ramp.lock);
 	g_firefly_pdata.enabled = true;
 	pwm_config(g_firefly_pdata.pwm, c, g_firefly_pdata.pwm_period_ns);
 	pwm_enable(g_firefly_pdata.pwm);
 	gval = c;
+	mutex_unlock(&ramp.lock);
 
 	return count;
 }
@@ -70,8 +190,102 @@ static ssize_t firefly_pwm_show(struct device *dev, \
 	return sprintf(buf, "%u\n", gval);
 }
 
+/* Start a ramp from the current duty to the value written */
+static ssize_t firefly_pwm_ramp_target_store(struct device *dev, \
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long state;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &state);
+	if (ret)
+		return ret;
+
+	firefly_pwm_ramp_stop();
+
+	mutex_lock(&ramp.lock);
+	ramp.from = gval;
+	ramp.to = firefly_pwm_clamp(state);
+	ramp.duty = gval;
+	ramp.duration_ns = (u64)ramp.ms * NSEC_PER_MSEC;
+	ramp.step_ns = max_t(u64, RAMP_STEP_NS, g_firefly_pdata.pwm_period_ns);
+	if (!g_firefly_pdata.enabled) {
+		pwm_config(g_firefly_pdata.pwm, gval, g_firefly_pdata.pwm_period_ns);
+		pwm_enable(g_firefly_pdata.pwm);
+		g_firefly_pdata.enabled = true;
+	}
+	ramp.start = ktime_get();
+	mutex_unlock(&ramp.lock);
+
+	hrtimer_start(&ramp.timer, 0, HRTIMER_MODE_REL_HARD);
+
+	return count;
+}
+static ssize_t firefly_pwm_ramp_target_show(struct device *dev, \
+		struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ramp.to);
+}
+
+static ssize_t firefly_pwm_ramp_ms_store(struct device *dev, \
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int ms;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &ms);
+	if (ret)
+		return ret;
+	if (ms > RAMP_MS_MAX)
+		return -EINVAL;
+
+	/* takes effect from the next ramp */
+	WRITE_ONCE(ramp.ms, ms);
+
+	return count;
+}
+static ssize_t firefly_pwm_ramp_ms_show(struct device *dev, \
+		struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(ramp.ms));
+}
+
+static ssize_t firefly_pwm_ramp_curve_store(struct device *dev, \
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int curve = sysfs_match_string(ramp_curves, buf);
+
+	if (curve < 0)
+		return curve;
+
+	firefly_pwm_ramp_stop();
+	ramp.curve = curve;
+
+	return count;
+}
+static ssize_t firefly_pwm_ramp_curve_show(struct device *dev, \
+		struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", ramp_curves[ramp.curve]);
+}
+
 static struct kobject *pwm_kobj;
 static DEVICE_ATTR(pwm, (S_IWUSR|S_IRUSR|S_IWGRP|S_IRGRP), firefly_pwm_show, firefly_pwm_store);
+static DEVICE_ATTR(ramp_target, (S_IWUSR|S_IRUSR|S_IWGRP|S_IRGRP), firefly_pwm_ramp_target_show, firefly_pwm_ramp_target_store);
+static DEVICE_ATTR(ramp_ms, (S_IWUSR|S_IRUSR|S_IWGRP|S_IRGRP), firefly_pwm_ramp_ms_show, firefly_pwm_ramp_ms_store);
+static DEVICE_ATTR(ramp_curve, (S_IWUSR|S_IRUSR|S_IWGRP|S_IRGRP), firefly_pwm_ramp_curve_show, firefly_pwm_ramp_curve_store);
+
+static struct attribute *firefly_pwm_attrs[] = {
+	&dev_attr_pwm.attr,
+	&dev_attr_ramp_target.attr,
+	&dev_attr_ramp_ms.attr,
+	&dev_attr_ramp_curve.attr,
+	NULL,
+};
+
+static const struct attribute_group firefly_pwm_attr_group = {
+	.attrs = firefly_pwm_attrs,
+};
 #endif
 
 static int firefly_pwm_status_update(struct firefly_pwm_data *pdata)
@@ -166,6 +380,19 @@ static int firefly_pwm_probe(struct platform_device *pdev)
 	firefly_pwm_status_update(firefly_pdata);
 	printk("%s: Firefly PWM Demo !\n", __func__);
 
+	mutex_init(&ramp.lock);
+	hrtimer_init(&ramp.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	ramp.timer.function = firefly_pwm_ramp_step;
+	kthread_init_work(&ramp.apply, firefly_pwm_ramp_apply);
+	ramp.worker = kthread_create_worker(0, "firefly_pwm_ramp");
+	if (IS_ERR(ramp.worker)) {
+		ret = PTR_ERR(ramp.worker);
+		ramp.worker = NULL;
+		goto err;
+	}
+	/* steps land on time even with the CPUs busy */
+	sched_set_fifo_low(ramp.worker->task);
+
 #ifdef SYS_DEV_CONFIG
 	pwm_kobj = kobject_create_and_add("pwm", NULL);
 	if (pwm_kobj == NULL) {
@@ -174,7 +401,7 @@ static int firefly_pwm_probe(struct platform_device *pdev)
 		goto err;
 	}
 
-	ret = sysfs_create_file(pwm_kobj, &dev_attr_pwm.attr);
+	ret = sysfs_create_group(pwm_kobj, &firefly_pwm_attr_group);
 	if (ret) {
 	printk("pwm firefly_sysfs_init: sysfs_create_group failed\n");
 	goto err;
@@ -185,6 +412,8 @@ err:
 #ifdef SYS_DEV_CONFIG
 	kobject_del(pwm_kobj);
 #endif
+	if (ramp.worker)
+		kthread_destroy_worker(ramp.worker);
 	pwm_free(firefly_pdata->pwm);
 	return ret;
 }
@@ -195,6 +424,8 @@ static int firefly_pwm_remove(struct platform_device *pdev)
 #ifdef SYS_DEV_CONFIG
 	kobject_del(pwm_kobj);
 #endif
+	firefly_pwm_ramp_stop();
+	kthread_destroy_worker(ramp.worker);
 
 	pwm_disable(firefly_pdata->pwm); 
     pwm_put(firefly_pdata->chip);    
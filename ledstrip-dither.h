@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Temporal dithering of deep (16-bit per channel) LED frames down to the
+ * 8-bit wire levels, for the kernel driver (rockchip-pwm-mod.c). Kept
+ * apart, like ledstrip-tribuf.h, so the host can check it against the
+ * plain per-channel version and time both.
+ *
+ * Each channel is corrected to an 8.8 output level through its table
+ * first, so the levels dithered between are the ones the LEDs get. The
+ * fraction of every channel is carried to the next refresh in @err.
+ */
+
+#ifndef _LEDSTRIP_DITHER_H
+#define _LEDSTRIP_DITHER_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#define LEDSTRIP_DITHER_CHANNELS	3 // R, G, B
+#define LEDSTRIP_DITHER_LANES		4 // 16-bit lanes in a 64-bit word
+#define LEDSTRIP_DITHER_LO_BYTES	0x00ff00ff00ff00ffULL
+/* Channels per unrolled step: four LEDs fill three lane words */
+#define LEDSTRIP_DITHER_STEP		(LEDSTRIP_DITHER_LANES * LEDSTRIP_DITHER_CHANNELS)
+
+/*
+ * Corrected output level of the 16-bit input @v in 8.8 fixed point. @v is
+ * scaled to 8.8 as v - (v >> 8), so 0xffff maps to 0xff00, and the result
+ * interpolated between the entries of its two neighbouring 8-bit levels;
+ * @corr has 257 entries.
+ */
+static inline uint16_t ledstrip_dither_corr16(const uint16_t *corr, uint16_t v)
+{
+	uint32_t x = v - (v >> 8);
+	int32_t lo = corr[x >> 8], hi = corr[(x >> 8) + 1];
+
+	return lo + (((hi - lo) * (int32_t)(x & 0xff)) >> 8);
+}
+
+/*
+ * One dither step for four channels at once, SWAR on 16-bit lanes of a
+ * u64. Each lane holds an 8.8 output level of at most 0xff00, so adding
+ * the 0.8 error can never carry into the next lane. The integer part
+ * goes out, the fraction is kept for the next refresh.
+ */
+static inline uint32_t ledstrip_dither4(uint64_t v, uint64_t *err)
+{
+	uint64_t sum, out;
+
+	sum = v + *err;
+	*err = sum & LEDSTRIP_DITHER_LO_BYTES;
+	out = (sum >> 8) & LEDSTRIP_DITHER_LO_BYTES;
+
+	/* pack the low byte of each lane */
+	out = (out | (out >> 8)) & 0x0000ffff0000ffffULL;
+	return out | (out >> 16);
+}
+
+/* One channel at a time; the reference, and the tail of the fast path */
+static inline bool ledstrip_dither_scalar(const uint16_t *rgb16, size_t bytes,
+					  const uint16_t *const corr[3],
+					  uint16_t *err, uint8_t *out)
+{
+	unsigned int frac = 0, sum, c = 0;
+	uint16_t level;
+	size_t i;
+
+	for (i = 0; i < bytes; i++) {
+		level = ledstrip_dither_corr16(corr[c], rgb16[i]);
+		c = c == LEDSTRIP_DITHER_CHANNELS - 1 ? 0 : c + 1;
+		frac |= level;
+		sum = level + err[i];
+		err[i] = sum & 0xff;
+		out[i] = sum >> 8;
+	}
+
+	return frac & 0xff;
+}
+
+/*
+ * Dither @bytes channels of R, G, B input @rgb16 into @out. Returns true
+ * while any output level has a fraction, i.e. further refreshes would
+ * still change what the strip shows.
+ *
+ * Four LEDs at a time: twelve channels fill three lane words exactly, so
+ * every lane's table is fixed and the interpolations unroll without the
+ * per-channel table switch. The lane packing assumes little-endian loads
+ * and stores; big-endian builds take the scalar path.
+ */
+static inline bool ledstrip_dither(const uint16_t *rgb16, size_t bytes,
+				   const uint16_t *const corr[3],
+				   uint16_t *err, uint8_t *out)
+{
+	uint16_t level[LEDSTRIP_DITHER_STEP];
+	uint64_t v, e, frac = 0;
+	uint32_t packed;
+	size_t i = 0;
+	bool tail;
+	int l, w;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; i + LEDSTRIP_DITHER_STEP <= bytes; i += LEDSTRIP_DITHER_STEP) {
+		for (l = 0; l < LEDSTRIP_DITHER_STEP; l += LEDSTRIP_DITHER_CHANNELS) {
+			level[l] = ledstrip_dither_corr16(corr[0], rgb16[i + l]);
+			level[l + 1] = ledstrip_dither_corr16(corr[1], rgb16[i + l + 1]);
+			level[l + 2] = ledstrip_dither_corr16(corr[2], rgb16[i + l + 2]);
+		}
+		for (w = 0; w < LEDSTRIP_DITHER_STEP; w += LEDSTRIP_DITHER_LANES) {
+			memcpy(&v, &level[w], sizeof(v));
+			memcpy(&e, &err[i + w], sizeof(e));
+			frac |= v;
+			packed = ledstrip_dither4(v, &e);
+			memcpy(&err[i + w], &e, sizeof(e));
+			memcpy(&out[i + w], &packed, sizeof(packed));
+		}
+	}
+#endif
+
+	tail = ledstrip_dither_scalar(rgb16 + i, bytes - i, corr, err + i, out + i);
+
+	return tail || (frac & LEDSTRIP_DITHER_LO_BYTES);
+}
+
+#endif /* _LEDSTRIP_DITHER_H */
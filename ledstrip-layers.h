@@ -0,0 +1,171 @@
+/*
+    LEDSTRIP LAYERS
+    Shared-memory layout and client side of ledstripd, the daemon that owns
+    /dev/ledstrip-* and composites the strip from layers of several client
+    processes.
+
+    A client connects to the daemon's socket and asks for a layer: a run of
+    LEDs of the strip, a z-order and an opacity. The daemon answers with a
+    memfd holding a struct ledlayer, which both sides map. From then on the
+    client paints straight into the mapping, only the pixels that change,
+    and publishes them with one commit; nothing is copied over the socket.
+    The layer goes away when the connection closes.
+
+    The commit counter works as a sequence lock: it is odd while the client
+    is writing, and the daemon only takes a snapshot of the layer when it
+    is even and unchanged across the copy, so it never shows half a commit.
+
+        struct ledlayer *l = ledlayer_open(LEDLAYER_SOCKET, "status", 0, 8, 10, 255, &fd);
+        ledlayer_begin(l);
+        ledlayer_set(l, 3, 0xff0000, 255);
+        ledlayer_commit(l);
+*/
+
+#ifndef _LEDSTRIP_LAYERS_H
+#define _LEDSTRIP_LAYERS_H
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LEDLAYER_SOCKET         "/run/ledstripd.sock"
+#define LEDLAYER_VERSION        1
+#define LEDLAYER_NAME_MAX       32
+#define LEDLAYER_BPP            4       // R, G, B, alpha
+
+// -------- Socket Protocol --------
+// Client to daemon, one message per connection
+struct ledlayer_request
+{
+    uint32_t version;
+    uint32_t start;                     // first LED of the strip covered
+    uint32_t count;                     // LEDs covered
+    int32_t z;                          // higher z is drawn on top
+    uint32_t alpha;                     // layer opacity, 0 to 255
+    char name[LEDLAYER_NAME_MAX];
+};
+
+// Daemon to client, with the layer's memfd attached when status is 0
+struct ledlayer_reply
+{
+    int32_t status;                     // 0 or a negative errno
+    uint32_t size;                      // bytes to map
+};
+
+// -------- Shared Memory --------
+struct ledlayer
+{
+    uint32_t version;
+    uint32_t start;                     // as granted, read-only
+    uint32_t count;
+    _Atomic int32_t z;                  // may be changed at any time
+    _Atomic uint32_t alpha;
+    _Atomic uint32_t commit;            // odd while the client is writing
+    uint32_t reserved[2];
+    uint8_t pixels[];                   // count * LEDLAYER_BPP
+};
+
+static inline size_t ledlayer_size(uint32_t count)
+{
+    return sizeof(struct ledlayer) + (size_t)count * LEDLAYER_BPP;
+}
+
+// -------- Client --------
+// Start a commit: from here the daemon leaves the layer alone
+static inline void ledlayer_begin(struct ledlayer *l)
+{
+    uint32_t c = atomic_load_explicit(&l->commit, memory_order_relaxed);
+
+    atomic_store_explicit(&l->commit, c + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Publish every pixel written since ledlayer_begin()
+static inline void ledlayer_commit(struct ledlayer *l)
+{
+    uint32_t c = atomic_load_explicit(&l->commit, memory_order_relaxed);
+
+    atomic_store_explicit(&l->commit, c + 1, memory_order_release);
+}
+
+// Set LED @i of the layer to 0xRRGGBB with per-pixel @alpha
+static inline void ledlayer_set(struct ledlayer *l, uint32_t i, uint32_t rgb, uint8_t alpha)
+{
+    uint8_t *px = &l->pixels[i * LEDLAYER_BPP];
+
+    px[0] = rgb >> 16;
+    px[1] = rgb >> 8;
+    px[2] = rgb;
+    px[3] = alpha;
+}
+
+/*
+    Ask the daemon at @path for a layer and map it. Returns NULL on error,
+    with errno set. Keep *@sock open for as long as the layer is wanted.
+*/
+static inline struct ledlayer *ledlayer_open(const char *path, const char *name,
+                                             uint32_t start, uint32_t count,
+                                             int32_t z, uint8_t alpha, int *sock)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct ledlayer_request req = {
+        .version = LEDLAYER_VERSION,
+        .start = start,
+        .count = count,
+        .z = z,
+        .alpha = alpha,
+    };
+    struct ledlayer_reply reply;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &reply, sizeof(reply) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cbuf,
+        .msg_controllen = sizeof(cbuf),
+    };
+    struct cmsghdr *cmsg;
+    struct ledlayer *l;
+    int fd = -1, s;
+
+    strncpy(req.name, name, LEDLAYER_NAME_MAX - 1);
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if ((s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+        return NULL;
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        send(s, &req, sizeof(req), 0) != sizeof(req) ||
+        recvmsg(s, &msg, MSG_CMSG_CLOEXEC) != sizeof(reply))
+        goto fail;
+
+    if (reply.status < 0)
+    {
+        close(s);
+        errno = -reply.status;
+        return NULL;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+        goto fail;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+    l = mmap(NULL, reply.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (l == MAP_FAILED)
+        goto fail;
+
+    *sock = s;
+    return l;
+
+fail:
+    close(s);
+    return NULL;
+}
+
+#endif /* _LEDSTRIP_LAYERS_H */
@@ -0,0 +1,789 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "rockchip-pwm-ledstrip.h"
+
+/*
+    LEDSTRIP NETWORK RECEIVER
+    Feeds a strip from a media server over sACN (E1.31, UDP 5568) and DDP
+    (UDP 4048). Datagrams are taken in batches with recvmmsg() and decoded
+    where they landed: the DMX or DDP payload is copied once, straight to
+    its place in the frame, which goes to the device as soon as it is
+    complete.
+
+    E1.31 universes map onto the strip one after the other from -u, each
+    carrying -c channels (510 by default, 170 RGB LEDs). A frame is complete
+    once every universe it spans has arrived, or, if the source uses
+    synchronisation, on its sync packet. DDP offsets are byte offsets into
+    the R, G, B frame and the PUSH flag completes it.
+
+    Latency is measured from the kernel receive timestamp of the first
+    packet of a frame to the moment the driver reports that frame on the
+    wire (LEDSTRIP_IOC_GET_STATUS). For outputs without the ioctl, e.g. a
+    plain file with -n, it stops at the write.
+
+    -D presents every frame a fixed delay after its first packet arrived
+    (LEDSTRIP_IOC_SET_FRAME_AT) instead of as soon as possible. Receivers
+    of the same multicast stream then show it together, to within their
+    network jitter, and the error against the target is reported too.
+
+    -g turns it into a generator instead, sending a moving rainbow in either
+    protocol to -t, so the receiver can be exercised over loopback.
+
+    Usage: ledstrip-net -d /dev/ledstrip-X [-n leds] [-u universe] [-c channels] [-b addr] [-m] [-D delay_us] [-i secs]
+           ledstrip-net -g e131|ddp [-t host] [-n leds] [-u universe] [-c channels] [-r fps] [-f frames]
+*/
+
+// -------- Debug --------
+#define DEBUG   1       // Print non-zero print debug
+
+// -------- Protocols --------
+#define E131_PORT               5568
+#define E131_HEADER             126         // up to and including the start code
+#define E131_SYNC_LEN           49
+#define E131_CHANNELS_MAX       512
+#define E131_ROOT_DATA          0x00000004
+#define E131_ROOT_EXTENDED      0x00000008
+#define E131_FRAMING_DATA       0x00000002
+#define E131_FRAMING_SYNC       0x00000001
+#define E131_OPT_PREVIEW        0x80
+#define E131_OPT_TERMINATED     0x40
+
+#define DDP_PORT                4048
+#define DDP_HEADER              10
+#define DDP_HEADER_TC           14
+#define DDP_VER_MASK            0xc0
+#define DDP_VER1                0x40
+#define DDP_FLAG_TIMECODE       0x10
+#define DDP_FLAG_STORAGE        0x08
+#define DDP_FLAG_REPLY          0x04
+#define DDP_FLAG_QUERY          0x02
+#define DDP_FLAG_PUSH           0x01
+#define DDP_ID_DISPLAY          1
+#define DDP_TYPE_RGB8           0x0b
+#define DDP_CHUNK_MAX           1440        // payload bytes per generated packet
+
+// -------- Receiver --------
+#define BATCH                   32          // datagrams per recvmmsg()
+#define PKT_MAX                 1500
+#define LEDS_MAX                4096
+#define UNIVERSES_MAX           (LEDS_MAX * 3)   // at 1 channel per universe
+#define STATUS_POLL_MS          1           // while a frame is on its way out
+#define PENDING                 8           // frames written, not yet seen on the wire
+
+static const uint8_t e131_acn_id[12] = "ASC-E1.17\0\0";
+
+// ----- MGMT -----
+void FAIL(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static volatile sig_atomic_t stop;
+
+void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline uint64_t ts_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+uint64_t now_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ts_ns(&ts);
+}
+
+// ----- RECEIVER -----
+struct pending
+{
+    uint64_t seq;                   // driver frame number, 0 when unknown
+    uint64_t arrival_ns;            // first packet, CLOCK_MONOTONIC
+};
+
+struct stats
+{
+    uint64_t packets;
+    uint64_t batches;
+    uint64_t dropped;               // bad, out of sequence or out of range
+    uint64_t frames;                // written to the device
+    uint64_t shown;                 // seen on the wire
+    uint64_t overtaken;             // replaced before a refresh
+    uint64_t lat_min, lat_max, lat_sum;
+    uint64_t timed;                 // shown with a target
+    int64_t err_max, err_sum;       // latched minus target
+};
+
+struct receiver
+{
+    int fd;
+    int regular;
+    int status;                     // device answers LEDSTRIP_IOC_GET_STATUS
+    uint64_t delay_ns;              // present at arrival + delay, 0 for at once
+    uint32_t leds;
+    size_t len;                     // frame bytes
+    uint8_t *frame;
+
+    // E1.31 mapping and state
+    uint16_t universe;              // first universe
+    uint32_t channels;              // per universe
+    uint32_t universes;             // spanned by the strip
+    uint8_t seq[UNIVERSES_MAX];
+    uint8_t seq_valid[UNIVERSES_MAX];
+    uint8_t got[UNIVERSES_MAX];
+    uint32_t ngot;
+    uint16_t sync;                  // sync address of the current frame, 0 for none
+
+    // Frame being assembled
+    int dirty;
+    uint64_t arrival_ns;
+
+    struct pending pending[PENDING];
+    int npending;
+    struct stats st;
+};
+
+void stat_latency(struct stats *st, uint64_t ns)
+{
+    if (st->shown == 0 || ns < st->lat_min)
+        st->lat_min = ns;
+    if (ns > st->lat_max)
+        st->lat_max = ns;
+    st->lat_sum += ns;
+    st->shown++;
+}
+
+void stat_error(struct stats *st, int64_t ns)
+{
+    int64_t mag = ns < 0 ? -ns : ns;
+
+    if (st->timed == 0 || mag > st->err_max)
+        st->err_max = mag;
+    st->err_sum += ns;
+    st->timed++;
+}
+
+// Match written frames against what the driver says went out
+void status_poll(struct receiver *rx)
+{
+    struct ledstrip_status s;
+    int i, n = 0;
+
+    if (rx->npending == 0 || ioctl(rx->fd, LEDSTRIP_IOC_GET_STATUS, &s) < 0)
+        return;
+
+    for (i = 0; i < rx->npending; ++i)
+    {
+        struct pending *p = &rx->pending[i];
+
+        if (p->seq > s.sent)
+            rx->pending[n++] = *p;
+        else if (p->seq == s.sent)
+        {
+            stat_latency(&rx->st, s.sent_ns - p->arrival_ns);
+            if (s.target_ns)
+                stat_error(&rx->st, s.present_ns - s.target_ns);
+        }
+        else
+            rx->st.overtaken++;
+    }
+    rx->npending = n;
+}
+
+void frame_flush(struct receiver *rx)
+{
+    struct ledstrip_status s;
+    ssize_t n;
+
+    if (!rx->dirty)
+        return;
+
+    if (rx->delay_ns && rx->status)
+    {
+        struct ledstrip_timed_frame tf = {
+            .pixels = (uintptr_t)rx->frame,
+            .len = rx->len,
+            .clock = CLOCK_MONOTONIC,
+            .present_ns = rx->arrival_ns + rx->delay_ns,
+        };
+
+        n = ioctl(rx->fd, LEDSTRIP_IOC_SET_FRAME_AT, &tf) == 0 ? (ssize_t)rx->len : -1;
+    }
+    else if (rx->regular)
+        n = pwrite(rx->fd, rx->frame, rx->len, 0);
+    else
+        n = write(rx->fd, rx->frame, rx->len);
+    if (n != (ssize_t)rx->len)
+    {
+        perror("[LIGHT] WARNING: frame write");
+        goto out;
+    }
+    rx->st.frames++;
+
+    if (!rx->status)
+    {
+        stat_latency(&rx->st, now_ns(CLOCK_MONOTONIC) - rx->arrival_ns);
+        goto out;
+    }
+
+    // With a single writer the newest frame number is the one just written
+    if (ioctl(rx->fd, LEDSTRIP_IOC_GET_STATUS, &s) == 0)
+    {
+        if (rx->npending == PENDING)
+        {
+            memmove(rx->pending, rx->pending + 1, (PENDING - 1) * sizeof(rx->pending[0]));
+            rx->npending--;
+            rx->st.overtaken++;
+        }
+        rx->pending[rx->npending++] = (struct pending){ s.published, rx->arrival_ns };
+    }
+
+out:
+    rx->dirty = 0;
+    rx->ngot = 0;
+    rx->sync = 0;
+    memset(rx->got, 0, rx->universes);
+}
+
+static inline void frame_touch(struct receiver *rx, uint64_t arrival_ns)
+{
+    if (!rx->dirty)
+        rx->arrival_ns = arrival_ns;
+    rx->dirty = 1;
+}
+
+/*
+    E1.31 sequence rule: a packet up to 20 behind the last one is late
+    and dropped, anything else (including a restarted source) is taken.
+*/
+static inline int e131_in_sequence(struct receiver *rx, uint32_t u, uint8_t seq)
+{
+    int8_t diff = seq - rx->seq[u];
+
+    if (rx->seq_valid[u] && diff <= 0 && diff > -20)
+        return 0;
+    rx->seq[u] = seq;
+    rx->seq_valid[u] = 1;
+    return 1;
+}
+
+void e131_decode(struct receiver *rx, const uint8_t *p, size_t len, uint64_t arrival_ns)
+{
+    uint32_t root, u, count, off;
+    uint16_t universe;
+
+    if (len < E131_SYNC_LEN || get_be16(p) != 0x0010 || memcmp(p + 4, e131_acn_id, 12) != 0)
+        goto drop;
+
+    root = get_be32(p + 18);
+    if (root == E131_ROOT_EXTENDED)
+    {
+        // Sync: the frame held for this address goes out now
+        if (get_be32(p + 40) == E131_FRAMING_SYNC && rx->sync && get_be16(p + 45) == rx->sync)
+            frame_flush(rx);
+        return;
+    }
+    if (root != E131_ROOT_DATA || len < E131_HEADER || get_be32(p + 40) != E131_FRAMING_DATA)
+        goto drop;
+    if (p[112] & (E131_OPT_PREVIEW | E131_OPT_TERMINATED) || p[125] != 0)
+        return;
+
+    universe = get_be16(p + 113);
+    u = (uint16_t)(universe - rx->universe);
+    if (u >= rx->universes || !e131_in_sequence(rx, u, p[111]))
+        goto drop;
+
+    // Property count includes the start code
+    count = get_be16(p + 123);
+    if (count == 0 || count - 1 > len - E131_HEADER)
+        goto drop;
+    count--;
+    if (count > rx->channels)
+        count = rx->channels;
+    off = u * rx->channels;
+    if (off + count > rx->len)
+        count = rx->len - off;
+
+    memcpy(rx->frame + off, p + E131_HEADER, count);
+    frame_touch(rx, arrival_ns);
+    rx->sync = get_be16(p + 109);
+    if (!rx->got[u])
+    {
+        rx->got[u] = 1;
+        rx->ngot++;
+    }
+    if (rx->ngot == rx->universes && rx->sync == 0)
+        frame_flush(rx);
+    return;
+
+drop:
+    rx->st.dropped++;
+}
+
+void ddp_decode(struct receiver *rx, const uint8_t *p, size_t len, uint64_t arrival_ns)
+{
+    size_t hdr = DDP_HEADER;
+    uint32_t off, count;
+
+    if (len < DDP_HEADER || (p[0] & DDP_VER_MASK) != DDP_VER1)
+        goto drop;
+    if (p[0] & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE) || p[3] != DDP_ID_DISPLAY)
+        return;
+    if (p[0] & DDP_FLAG_TIMECODE)
+        hdr = DDP_HEADER_TC;
+
+    off = get_be32(p + 4);
+    count = get_be16(p + 8);
+    if (len < hdr || count > len - hdr || off > rx->len)
+        goto drop;
+    if (count > rx->len - off)
+        count = rx->len - off;
+
+    memcpy(rx->frame + off, p + hdr, count);
+    frame_touch(rx, arrival_ns);
+    if (p[0] & DDP_FLAG_PUSH)
+        frame_flush(rx);
+    return;
+
+drop:
+    rx->st.dropped++;
+}
+
+int udp_socket(const char *addr, uint16_t port)
+{
+    struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons(port) };
+    int s, one = 1, rcvbuf = 1 << 20;
+
+    if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1)
+        FAIL("[LIGHT] ERROR: bad bind address");
+    if ((s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+        FAIL("[LIGHT] ERROR: socket");
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    // Kernel receive time, for latency from the wire rather than from us
+    if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0)
+        FAIL("[LIGHT] ERROR: SO_TIMESTAMPNS");
+    if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+        FAIL("[LIGHT] ERROR: bind");
+
+    return s;
+}
+
+// sACN multicast group of each universe the strip spans, 239.255.hi.lo
+void e131_join(int s, struct receiver *rx)
+{
+    for (uint32_t u = 0; u < rx->universes; ++u)
+    {
+        uint16_t universe = rx->universe + u;
+        struct ip_mreq mreq = {
+            .imr_multiaddr.s_addr = htonl(0xefff0000 | universe),
+            .imr_interface.s_addr = htonl(INADDR_ANY),
+        };
+
+        if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+            perror("[LIGHT] WARNING: multicast join");
+    }
+}
+
+struct batch
+{
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+    uint8_t buf[BATCH][PKT_MAX];
+    char ctrl[BATCH][CMSG_SPACE(sizeof(struct timespec))];
+};
+
+void batch_init(struct batch *b)
+{
+    for (int i = 0; i < BATCH; ++i)
+    {
+        b->iov[i] = (struct iovec){ b->buf[i], PKT_MAX };
+        b->msgs[i].msg_hdr = (struct msghdr){
+            .msg_iov = &b->iov[i],
+            .msg_iovlen = 1,
+        };
+    }
+}
+
+// Drain one socket, a batch at a time, decoding in place
+void batch_receive(struct receiver *rx, struct batch *b, int s, int ddp)
+{
+    int n;
+
+    do
+    {
+        // recvmmsg() shrinks the control lengths, give them back each time
+        for (int i = 0; i < BATCH; ++i)
+        {
+            b->msgs[i].msg_hdr.msg_control = b->ctrl[i];
+            b->msgs[i].msg_hdr.msg_controllen = sizeof(b->ctrl[i]);
+        }
+
+        n = recvmmsg(s, b->msgs, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0)
+            return;
+        rx->st.batches++;
+        rx->st.packets += n;
+
+        // Receive timestamps are CLOCK_REALTIME, move them to CLOCK_MONOTONIC
+        int64_t offset = now_ns(CLOCK_REALTIME) - now_ns(CLOCK_MONOTONIC);
+
+        for (int i = 0; i < n; ++i)
+        {
+            struct msghdr *mh = &b->msgs[i].msg_hdr;
+            uint64_t arrival = now_ns(CLOCK_MONOTONIC);
+            struct cmsghdr *c;
+
+            for (c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR(mh, c))
+            {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    struct timespec ts;
+
+                    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    arrival = ts_ns(&ts) - offset;
+                }
+            }
+
+            if (ddp)
+                ddp_decode(rx, b->buf[i], b->msgs[i].msg_len, arrival);
+            else
+                e131_decode(rx, b->buf[i], b->msgs[i].msg_len, arrival);
+        }
+    } while (n == BATCH);
+}
+
+void stats_print(struct receiver *rx, double secs)
+{
+    struct stats *st = &rx->st;
+
+    printf("[LIGHT] %.0f pkt/s, %.1f pkt/batch, %.1f frames/s, %llu dropped, %llu overtaken",
+           st->packets / secs, st->batches ? (double)st->packets / st->batches : 0.0,
+           st->frames / secs, (unsigned long long)st->dropped, (unsigned long long)st->overtaken);
+    if (st->shown)
+        printf(", latency to %s min/avg/max %.0f/%.0f/%.0f us",
+               rx->status ? "wire" : "write",
+               st->lat_min / 1e3, (double)st->lat_sum / st->shown / 1e3, st->lat_max / 1e3);
+    if (st->timed)
+        printf(", present error avg/max %.0f/%.0f us",
+               (double)st->err_sum / st->timed / 1e3, st->err_max / 1e3);
+    printf("\n");
+    fflush(stdout);
+    memset(st, 0, sizeof(*st));
+}
+
+int run_receiver(const char *device, const char *bind_addr, uint32_t leds,
+                 uint16_t universe, uint32_t channels, int multicast,
+                 uint64_t delay_ns, int interval)
+{
+    struct receiver *rx = calloc(1, sizeof(*rx));
+    struct batch *b = malloc(sizeof(*b));
+    struct ledstrip_config cfg;
+    struct ledstrip_status s;
+    struct pollfd pfd[2];
+    struct stat sb;
+    uint64_t last;
+
+    if (rx == NULL || b == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate receiver");
+    batch_init(b);
+
+    if ((rx->fd = open(device, O_WRONLY | O_CLOEXEC)) < 0)
+        FAIL("[LIGHT] ERROR: can't open output");
+    if (fstat(rx->fd, &sb) == 0)
+        rx->regular = S_ISREG(sb.st_mode);
+    if (leds == 0)
+    {
+        if (ioctl(rx->fd, LEDSTRIP_IOC_GET_CONFIG, &cfg) < 0)
+            FAIL("[LIGHT] ERROR: not a ledstrip device, give the length with -n");
+        leds = cfg.leds;
+    }
+    if (leds == 0 || leds > LEDS_MAX || channels == 0 || channels > E131_CHANNELS_MAX)
+    {
+        errno = EINVAL;
+        FAIL("[LIGHT] ERROR: strip length or channels per universe");
+    }
+    rx->status = ioctl(rx->fd, LEDSTRIP_IOC_GET_STATUS, &s) == 0;
+    rx->delay_ns = delay_ns;
+    if (delay_ns && !rx->status)
+        printf("[LIGHT] WARNING: output can't schedule frames, -D ignored\n");
+
+    rx->leds = leds;
+    rx->len = (size_t)leds * 3;
+    rx->frame = calloc(rx->len, 1);
+    if (rx->frame == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate frame");
+    rx->universe = universe;
+    rx->channels = channels;
+    rx->universes = (rx->len + channels - 1) / channels;
+
+    pfd[0] = (struct pollfd){ .fd = udp_socket(bind_addr, E131_PORT), .events = POLLIN };
+    pfd[1] = (struct pollfd){ .fd = udp_socket(bind_addr, DDP_PORT), .events = POLLIN };
+    if (multicast)
+        e131_join(pfd[0].fd, rx);
+
+    printf("[LIGHT] ledstrip-net: %s, %u LEDs, universes %u-%u of %u channels, latency to %s\n",
+           device, leds, universe, universe + rx->universes - 1, channels,
+           rx->status ? "wire" : "write");
+
+    last = now_ns(CLOCK_MONOTONIC);
+    while (!stop)
+    {
+        int timeout = rx->npending ? STATUS_POLL_MS : 100;
+
+        if (poll(pfd, 2, timeout) > 0)
+        {
+            if (pfd[0].revents & POLLIN)
+                batch_receive(rx, b, pfd[0].fd, 0);
+            if (pfd[1].revents & POLLIN)
+                batch_receive(rx, b, pfd[1].fd, 1);
+        }
+        status_poll(rx);
+
+        if (now_ns(CLOCK_MONOTONIC) - last >= (uint64_t)interval * 1000000000ULL)
+        {
+            stats_print(rx, (now_ns(CLOCK_MONOTONIC) - last) / 1e9);
+            last = now_ns(CLOCK_MONOTONIC);
+        }
+    }
+
+    close(pfd[0].fd);
+    close(pfd[1].fd);
+    close(rx->fd);
+    free(rx->frame);
+    free(rx);
+    free(b);
+
+    return 0;
+}
+
+// ----- GENERATOR -----
+void rainbow(uint8_t *frame, uint32_t leds, uint32_t step)
+{
+    for (uint32_t i = 0; i < leds; ++i)
+    {
+        uint32_t h = ((i * 256 / leds) + step) % 768;
+        uint8_t up = h % 256, down = 255 - up;
+        uint8_t *px = &frame[i * 3];
+
+        px[0] = h < 256 ? down : h < 512 ? 0 : up;
+        px[1] = h < 256 ? up : h < 512 ? down : 0;
+        px[2] = h < 256 ? 0 : h < 512 ? up : down;
+    }
+}
+
+// One frame as E1.31 data packets, or DDP packets with PUSH on the last
+int build_packets(int ddp, const uint8_t *frame, size_t len, uint16_t universe,
+                  uint32_t channels, uint8_t seq, uint8_t (*pkt)[PKT_MAX], struct iovec *iov)
+{
+    int n = 0;
+
+    for (size_t off = 0; off < len; ++n)
+    {
+        uint8_t *p = pkt[n];
+        size_t count;
+
+        if (ddp)
+        {
+            count = len - off < DDP_CHUNK_MAX ? len - off : DDP_CHUNK_MAX;
+            memset(p, 0, DDP_HEADER);
+            p[0] = DDP_VER1 | (off + count == len ? DDP_FLAG_PUSH : 0);
+            p[1] = seq & 0x0f;
+            p[2] = DDP_TYPE_RGB8;
+            p[3] = DDP_ID_DISPLAY;
+            put_be32(p + 4, off);
+            put_be16(p + 8, count);
+            memcpy(p + DDP_HEADER, frame + off, count);
+            iov[n] = (struct iovec){ p, DDP_HEADER + count };
+        }
+        else
+        {
+            count = len - off < channels ? len - off : channels;
+            memset(p, 0, E131_HEADER);
+            put_be16(p, 0x0010);
+            memcpy(p + 4, e131_acn_id, 12);
+            put_be16(p + 16, 0x7000 | (E131_HEADER + count - 16));
+            put_be32(p + 18, E131_ROOT_DATA);
+            memcpy(p + 22, "ledstrip-net gen", 16);             // CID
+            put_be16(p + 38, 0x7000 | (E131_HEADER + count - 38));
+            put_be32(p + 40, E131_FRAMING_DATA);
+            strcpy((char *)p + 44, "ledstrip-net");
+            p[108] = 100;                                        // priority
+            p[111] = seq;
+            put_be16(p + 113, universe + n);
+            put_be16(p + 115, 0x7000 | (E131_HEADER + count - 115));
+            p[117] = 0x02;
+            p[118] = 0xa1;
+            put_be16(p + 121, 1);
+            put_be16(p + 123, count + 1);
+            memcpy(p + E131_HEADER, frame + off, count);
+            iov[n] = (struct iovec){ p, E131_HEADER + count };
+        }
+        off += count;
+    }
+
+    return n;
+}
+
+int run_generator(const char *proto, const char *host, uint32_t leds, uint16_t universe,
+                  uint32_t channels, uint32_t fps, uint32_t frames)
+{
+    int ddp = strcmp(proto, "ddp") == 0;
+    struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(ddp ? DDP_PORT : E131_PORT) };
+    size_t len = (size_t)leds * 3;
+    uint32_t npkt = (len + (ddp ? DDP_CHUNK_MAX : channels) - 1) / (ddp ? DDP_CHUNK_MAX : channels);
+    uint8_t *frame = malloc(len);
+    uint8_t (*pkt)[PKT_MAX] = malloc(npkt * sizeof(*pkt));
+    struct iovec *iov = calloc(npkt, sizeof(*iov));
+    struct mmsghdr *msgs = calloc(npkt, sizeof(*msgs));
+    struct timespec next;
+    int s;
+
+    if (!ddp && strcmp(proto, "e131") != 0)
+        FAIL("[LIGHT] ERROR: protocol is e131 or ddp");
+    if (leds == 0 || leds > LEDS_MAX || channels == 0 || channels > E131_CHANNELS_MAX || fps == 0)
+    {
+        errno = EINVAL;
+        FAIL("[LIGHT] ERROR: generator parameters");
+    }
+    if (frame == NULL || pkt == NULL || iov == NULL || msgs == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate packets");
+    if (inet_pton(AF_INET, host, &to.sin_addr) != 1)
+        FAIL("[LIGHT] ERROR: bad target address");
+    if ((s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+        FAIL("[LIGHT] ERROR: socket");
+
+    printf("[LIGHT] generator: %s to %s, %u LEDs in %u packets at %u fps\n",
+           ddp ? "DDP" : "E1.31", host, leds, npkt, fps);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t f = 0; !stop && (frames == 0 || f < frames); ++f)
+    {
+        int n;
+
+        rainbow(frame, leds, f * 8);
+        n = build_packets(ddp, frame, len, universe, channels, f, pkt, iov);
+        for (int i = 0; i < n; ++i)
+            msgs[i].msg_hdr = (struct msghdr){
+                .msg_name = &to,
+                .msg_namelen = sizeof(to),
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1,
+            };
+        if (sendmmsg(s, msgs, n, 0) != n)
+            perror("[LIGHT] WARNING: sendmmsg");
+
+        next.tv_nsec += 1000000000L / fps;
+        while (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    close(s);
+    free(frame);
+    free(pkt);
+    free(iov);
+    free(msgs);
+
+    return 0;
+}
+
+// ----- PROGRAM -----
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -d /dev/ledstrip-X [-n leds] [-u universe] [-c channels] [-b addr] [-m] [-D delay_us] [-i secs]\n"
+                    "       %s -g e131|ddp [-t host] [-n leds] [-u universe] [-c channels] [-r fps] [-f frames]\n",
+            prog, prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL, *gen = NULL, *host = "127.0.0.1", *bind_addr = "0.0.0.0";
+    uint32_t leds = 0, channels = 510, fps = 40, frames = 0;
+    uint16_t universe = 1;
+    uint64_t delay_ns = 0;
+    int opt, multicast = 0, interval = 1;
+    struct sigaction sa = { .sa_handler = on_signal };
+
+    while ((opt = getopt(argc, argv, "d:n:u:c:b:mD:i:g:t:r:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'n': leds = strtoul(optarg, NULL, 0); break;
+        case 'u': universe = strtoul(optarg, NULL, 0); break;
+        case 'c': channels = strtoul(optarg, NULL, 0); break;
+        case 'b': bind_addr = optarg; break;
+        case 'm': multicast = 1; break;
+        case 'D': delay_ns = strtoull(optarg, NULL, 0) * 1000; break;
+        case 'i': interval = atoi(optarg); break;
+        case 'g': gen = optarg; break;
+        case 't': host = optarg; break;
+        case 'r': fps = strtoul(optarg, NULL, 0); break;
+        case 'f': frames = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (interval <= 0)
+        usage(argv[0]);
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (gen)
+        return run_generator(gen, host, leds ? leds : 170, universe, channels, fps, frames);
+    if (device == NULL)
+        usage(argv[0]);
+
+    return run_receiver(device, bind_addr, leds, universe, channels, multicast, delay_ns, interval);
+}
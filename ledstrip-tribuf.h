@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Triple-buffer index handoff between LED frame producers and the
+ * transmitter of the kernel driver (rockchip-pwm-mod.c), kept apart so the
+ * same code can be exercised on the host.
+ *
+ * Each side owns one of three buffers outright; the third is handed over
+ * with an atomic exchange of @latest, which carries FRESH while the buffer
+ * it names has not been taken by the consumer yet. Producers serialise
+ * among themselves, the consumer is single.
+ */
+
+#ifndef _LEDSTRIP_TRIBUF_H
+#define _LEDSTRIP_TRIBUF_H
+
+#ifdef __KERNEL__
+#include <linux/atomic.h>
+#include <linux/types.h>
+
+typedef atomic_t ledstrip_tribuf_atomic_t;
+#define ledstrip_tribuf_read(a)		atomic_read(a)
+#define ledstrip_tribuf_set(a, v)	atomic_set(a, v)
+/* Fully ordered, buffer contents are visible before the index */
+#define ledstrip_tribuf_xchg(a, v)	atomic_xchg(a, v)
+#else
+#include <stdbool.h>
+
+typedef int ledstrip_tribuf_atomic_t;
+#define ledstrip_tribuf_read(a)		__atomic_load_n(a, __ATOMIC_RELAXED)
+#define ledstrip_tribuf_set(a, v)	__atomic_store_n(a, v, __ATOMIC_RELAXED)
+#define ledstrip_tribuf_xchg(a, v)	__atomic_exchange_n(a, v, __ATOMIC_SEQ_CST)
+#endif
+
+#define LEDSTRIP_TRIBUF_BUFS	3
+#define LEDSTRIP_TRIBUF_FRESH	(1 << 7) // set in latest when unread
+
+struct ledstrip_tribuf {
+	unsigned int back;		/* producers */
+	ledstrip_tribuf_atomic_t latest;	/* shared, index | FRESH */
+	unsigned int front;		/* consumer */
+};
+
+static inline void ledstrip_tribuf_init(struct ledstrip_tribuf *tb)
+{
+	tb->back = 0;
+	ledstrip_tribuf_set(&tb->latest, 1);
+	tb->front = 2;
+}
+
+/* Index of the published buffer not yet taken by the consumer, or -1 */
+static inline int ledstrip_tribuf_peek(struct ledstrip_tribuf *tb)
+{
+	int latest = ledstrip_tribuf_read(&tb->latest);
+
+	return latest & LEDSTRIP_TRIBUF_FRESH ? latest & ~LEDSTRIP_TRIBUF_FRESH : -1;
+}
+
+static inline bool ledstrip_tribuf_fresh(struct ledstrip_tribuf *tb)
+{
+	return ledstrip_tribuf_peek(tb) >= 0;
+}
+
+/*
+ * Producer side: hands the filled back buffer over and returns the index
+ * of the buffer to fill next.
+ */
+static inline unsigned int ledstrip_tribuf_publish(struct ledstrip_tribuf *tb)
+{
+	int prev = ledstrip_tribuf_xchg(&tb->latest, tb->back | LEDSTRIP_TRIBUF_FRESH);
+
+	tb->back = prev & ~LEDSTRIP_TRIBUF_FRESH;
+
+	return tb->back;
+}
+
+/*
+ * Consumer side: swaps in the most recently published buffer if there is
+ * one, otherwise keeps the current one. Returns the front index.
+ */
+static inline unsigned int ledstrip_tribuf_acquire(struct ledstrip_tribuf *tb)
+{
+	int prev;
+
+	if (ledstrip_tribuf_fresh(tb)) {
+		prev = ledstrip_tribuf_xchg(&tb->latest, tb->front);
+		tb->front = prev & ~LEDSTRIP_TRIBUF_FRESH;
+	}
+
+	return tb->front;
+}
+
+#endif /* _LEDSTRIP_TRIBUF_H */
@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "rockchip-pwm-ledstrip.h"
+#include "ledstrip-layers.h"
+
+/*
+    LEDSTRIP LAYER DAEMON
+    Owns one strip and shares it between processes. Each client gets a layer
+    (ledstrip-layers.h): a run of the strip's LEDs in a memfd both sides map,
+    with a z-order and an opacity. At the refresh rate the daemon snapshots
+    every layer with a new commit, composites them bottom to top over black
+    and writes one frame to the device. Nothing is written when no layer
+    changed, and no pixel data crosses the socket.
+
+    Blending is fixed point, 4 pixels at a time with GCC vector extensions
+    where the compiler has them and a scalar loop with identical results
+    otherwise (or with -DNO_VECTOR).
+
+    The strip length comes from the driver (LEDSTRIP_IOC_GET_CONFIG); -n sets
+    it for anything else, e.g. a plain file to look at the output.
+
+    Usage: ledstripd -d /dev/ledstrip-X [-n leds] [-r fps] [-S socket]
+           ledstripd -c name [-S socket] [-s start] [-n count] [-z z] [-a alpha] [-m] RRGGBB
+*/
+
+// -------- Debug --------
+#define DEBUG   1       // Print non-zero print debug
+
+// -------- Daemon --------
+#define FPS             60      // Default refresh rate, override with -r
+#define FPS_MAX         1000
+#define MAX_CLIENTS     32
+#define LEDS_MAX        4096
+
+#if defined(__GNUC__) && __GNUC__ >= 9 && !defined(__clang__) && !defined(NO_VECTOR)
+#define BLEND_VECTOR    1
+#endif
+
+// ----- MGMT -----
+void FAIL(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static volatile sig_atomic_t stop;
+
+void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+// ----- LAYERS -----
+struct layer
+{
+    int sock;
+    struct ledlayer *shm;           // NULL until the client's request arrives
+    size_t size;
+    uint32_t start;                 // daemon's copies, the client can't move them
+    uint32_t count;
+    uint32_t seen;                  // commit of the last snapshot
+    int32_t z;
+    uint32_t alpha;
+    uint8_t *snap;                  // last complete commit, RGBA
+    char name[LEDLAYER_NAME_MAX];
+};
+
+struct strip
+{
+    int fd;
+    int regular;                    // plain file, rewrite from the start
+    uint32_t leds;
+    int32_t *acc;                   // composite, RGBA as int32 lanes
+    uint8_t *frame;                 // RGB, as written to the device
+    struct layer layers[MAX_CLIENTS];
+    int nlayers;
+};
+
+void layer_drop(struct strip *st, int i)
+{
+    struct layer *l = &st->layers[i];
+
+#if DEBUG
+    if (l->shm)
+        printf("[LIGHT] layer '%s' gone\n", l->name);
+#endif
+    if (l->shm)
+        munmap(l->shm, l->size);
+    free(l->snap);
+    close(l->sock);
+    st->layers[i] = st->layers[--st->nlayers];
+}
+
+// Send the reply, and the layer's memfd with it on success
+int layer_reply(int sock, int32_t status, uint32_t size, int memfd)
+{
+    struct ledlayer_reply reply = { .status = status, .size = size };
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &reply, sizeof(reply) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    struct cmsghdr *cmsg;
+
+    if (memfd >= 0)
+    {
+        memset(cbuf, 0, sizeof(cbuf));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(reply) ? 0 : -1;
+}
+
+// First message from a client: validate it and hand out the layer
+int layer_create(struct strip *st, struct layer *l)
+{
+    struct ledlayer_request req;
+    struct ledlayer *shm;
+    ssize_t n;
+    int memfd;
+
+    n = recv(l->sock, &req, sizeof(req), 0);
+    if (n <= 0)
+        return -1;
+    if (n != sizeof(req) || req.version != LEDLAYER_VERSION)
+        return layer_reply(l->sock, -EPROTO, 0, -1), -1;
+    if (req.count == 0 || req.count > st->leds || req.start > st->leds - req.count || req.alpha > 255)
+        return layer_reply(l->sock, -EINVAL, 0, -1), -1;
+
+    req.name[LEDLAYER_NAME_MAX - 1] = '\0';
+    l->size = ledlayer_size(req.count);
+    l->snap = calloc(req.count, LEDLAYER_BPP);
+    if (l->snap == NULL)
+        return layer_reply(l->sock, -ENOMEM, 0, -1), -1;
+
+    // Sealed so the client can't shrink it under the daemon's mapping
+    memfd = memfd_create(req.name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0 || ftruncate(memfd, l->size) < 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+        goto fail;
+    shm = mmap(NULL, l->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (shm == MAP_FAILED)
+        goto fail;
+
+    shm->version = LEDLAYER_VERSION;
+    shm->start = req.start;
+    shm->count = req.count;
+    atomic_init(&shm->z, req.z);
+    atomic_init(&shm->alpha, req.alpha);
+    atomic_init(&shm->commit, 0);
+
+    if (layer_reply(l->sock, 0, l->size, memfd) < 0)
+    {
+        munmap(shm, l->size);
+        close(memfd);
+        return -1;
+    }
+    close(memfd);
+
+    l->shm = shm;
+    l->start = req.start;
+    l->count = req.count;
+    l->seen = 0;
+    l->z = req.z;
+    l->alpha = req.alpha;
+    memcpy(l->name, req.name, sizeof(l->name));
+#if DEBUG
+    printf("[LIGHT] layer '%s': LEDs %u-%u, z %d, alpha %u\n",
+           l->name, l->start, l->start + l->count - 1, l->z, l->alpha);
+#endif
+    return 0;
+
+fail:
+    layer_reply(l->sock, -errno, 0, -1);
+    if (memfd >= 0)
+        close(memfd);
+    return -1;
+}
+
+/*
+    Take the client's latest commit if there is a new one. The copy only
+    counts if the commit was even (no commit in progress) and unchanged
+    across it, otherwise the previous snapshot stays and the next tick tries
+    again. Returns non-zero if anything the composite depends on changed.
+*/
+int layer_snapshot(struct layer *l)
+{
+    struct ledlayer *shm = l->shm;
+    int32_t z = atomic_load_explicit(&shm->z, memory_order_relaxed);
+    uint32_t alpha = atomic_load_explicit(&shm->alpha, memory_order_relaxed);
+    uint32_t seq = atomic_load_explicit(&shm->commit, memory_order_acquire);
+    int changed = 0;
+
+    if (alpha > 255)
+        alpha = 255;
+    if (z != l->z || alpha != l->alpha)
+    {
+        l->z = z;
+        l->alpha = alpha;
+        changed = 1;
+    }
+
+    if (seq == l->seen || (seq & 1))
+        return changed;
+
+    memcpy(l->snap, shm->pixels, (size_t)l->count * LEDLAYER_BPP);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&shm->commit, memory_order_relaxed) != seq)
+        return changed;
+
+    l->seen = seq;
+    return 1;
+}
+
+// ----- BLENDING -----
+/*
+    Source over, per channel: d += (s - d) * a / 256, where a is the pixel
+    alpha times the layer alpha, both 0-255 scaled to 0-256 so 255 is
+    exactly opaque.
+*/
+static inline int32_t blend_alpha(int32_t pa, int32_t la)
+{
+    int32_t a = (pa * (la + (la >> 7))) >> 8;
+
+    return a + (a >> 7);
+}
+
+void blend_scalar(int32_t *d, const uint8_t *s, uint32_t n, int32_t la)
+{
+    for (uint32_t i = 0; i < n; ++i, d += 4, s += 4)
+    {
+        int32_t a = blend_alpha(s[3], la);
+
+        d[0] += ((s[0] - d[0]) * a) >> 8;
+        d[1] += ((s[1] - d[1]) * a) >> 8;
+        d[2] += ((s[2] - d[2]) * a) >> 8;
+    }
+}
+
+#ifdef BLEND_VECTOR
+typedef uint8_t v16qu __attribute__((vector_size(16)));
+typedef int32_t v16si __attribute__((vector_size(64)));
+
+// 4 RGBA pixels per step, the same arithmetic as blend_scalar() lane-wise
+void blend(int32_t *d, const uint8_t *s, uint32_t n, int32_t la)
+{
+    const v16si spread = { 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15 };
+    const v16si lav = (v16si){} + (la + (la >> 7));
+    uint32_t i;
+
+    for (i = 0; i + 4 <= n; i += 4, d += 16, s += 16)
+    {
+        v16qu b;
+        v16si sv, dv, av;
+
+        memcpy(&b, s, sizeof(b));
+        memcpy(&dv, d, sizeof(dv));
+        sv = __builtin_convertvector(b, v16si);
+        av = (__builtin_shuffle(sv, spread) * lav) >> 8;
+        av += av >> 7;
+        dv += ((sv - dv) * av) >> 8;
+        memcpy(d, &dv, sizeof(dv));
+    }
+    blend_scalar(d, s, n - i, la);
+}
+#else
+void blend(int32_t *d, const uint8_t *s, uint32_t n, int32_t la)
+{
+    blend_scalar(d, s, n, la);
+}
+#endif
+
+// Bottom to top by z, layers with equal z in the order they connected
+void composite(struct strip *st)
+{
+    struct layer *order[MAX_CLIENTS];
+    int n = 0;
+
+    for (int i = 0; i < st->nlayers; ++i)
+    {
+        struct layer *l = &st->layers[i];
+        int j = n++;
+
+        if (l->shm == NULL || l->alpha == 0)
+        {
+            --n;
+            continue;
+        }
+        while (j > 0 && order[j - 1]->z > l->z)
+        {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = l;
+    }
+
+    memset(st->acc, 0, (size_t)st->leds * 4 * sizeof(int32_t));
+    for (int i = 0; i < n; ++i)
+        blend(&st->acc[order[i]->start * 4], order[i]->snap, order[i]->count, order[i]->alpha);
+
+    for (uint32_t i = 0; i < st->leds; ++i)
+    {
+        st->frame[i * 3 + 0] = st->acc[i * 4 + 0];
+        st->frame[i * 3 + 1] = st->acc[i * 4 + 1];
+        st->frame[i * 3 + 2] = st->acc[i * 4 + 2];
+    }
+}
+
+void strip_write(struct strip *st)
+{
+    size_t len = (size_t)st->leds * 3;
+    ssize_t n;
+
+    if (st->regular)
+        n = pwrite(st->fd, st->frame, len, 0);
+    else
+        n = write(st->fd, st->frame, len);
+    if (n != (ssize_t)len)
+        perror("[LIGHT] WARNING: frame write");
+}
+
+// ----- DAEMON -----
+int listen_socket(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int s;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        FAIL("[LIGHT] ERROR: socket path");
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if ((s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0 ||
+        bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(s, MAX_CLIENTS) < 0)
+        FAIL("[LIGHT] ERROR: can't listen on socket");
+
+    return s;
+}
+
+static inline void ts_add_ns(struct timespec *ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static inline int ts_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+int run_daemon(const char *device, const char *path, uint32_t leds, uint32_t fps)
+{
+    struct strip st = { .nlayers = 0 };
+    struct ledstrip_config cfg;
+    struct pollfd pfd[1 + MAX_CLIENTS];
+    struct timespec next, now, timeout;
+    long period = 1000000000L / fps;
+    struct stat sb;
+    int ls, dirty = 1;
+
+    if ((st.fd = open(device, O_WRONLY | O_CLOEXEC)) < 0)
+        FAIL("[LIGHT] ERROR: can't open output");
+    if (fstat(st.fd, &sb) == 0)
+        st.regular = S_ISREG(sb.st_mode);
+
+    // The driver knows the strip, -n only matters for other outputs
+    if (leds == 0)
+    {
+        if (ioctl(st.fd, LEDSTRIP_IOC_GET_CONFIG, &cfg) < 0)
+            FAIL("[LIGHT] ERROR: not a ledstrip device, give the length with -n");
+        leds = cfg.leds;
+    }
+    if (leds == 0 || leds > LEDS_MAX)
+    {
+        errno = EINVAL;
+        FAIL("[LIGHT] ERROR: strip length");
+    }
+    st.leds = leds;
+    st.acc = aligned_alloc(64, ((size_t)leds * 4 * sizeof(int32_t) + 63) & ~(size_t)63);
+    st.frame = malloc((size_t)leds * 3);
+    if (st.acc == NULL || st.frame == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate frame");
+
+    ls = listen_socket(path);
+    fprintf(stdout, "[LIGHT] ledstripd: %s, %u LEDs at %u fps, %s blending, clients on %s\n",
+            device, leds, fps,
+#ifdef BLEND_VECTOR
+            "vector",
+#else
+            "scalar",
+#endif
+            path);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!stop)
+    {
+        int n = 0;
+
+        pfd[n++] = (struct pollfd){ .fd = ls, .events = st.nlayers < MAX_CLIENTS ? POLLIN : 0 };
+        for (int i = 0; i < st.nlayers; ++i)
+            pfd[n++] = (struct pollfd){ .fd = st.layers[i].sock, .events = POLLIN };
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = 0;
+        if (ts_before(&now, &next))
+        {
+            timeout.tv_sec = next.tv_sec - now.tv_sec;
+            timeout.tv_nsec = next.tv_nsec - now.tv_nsec;
+            if (timeout.tv_nsec < 0)
+            {
+                timeout.tv_nsec += 1000000000L;
+                timeout.tv_sec--;
+            }
+        }
+
+        if (ppoll(pfd, n, &timeout, NULL) > 0)
+        {
+            // Clients: the request, or a hangup. Walk backwards, drops reorder
+            for (int i = st.nlayers - 1; i >= 0; --i)
+            {
+                struct layer *l = &st.layers[i];
+
+                if (pfd[1 + i].revents == 0)
+                    continue;
+                if (l->shm == NULL && (pfd[1 + i].revents & POLLIN) && layer_create(&st, l) == 0)
+                {
+                    dirty = 1;
+                    continue;
+                }
+                if (l->shm)
+                    dirty = 1;
+                layer_drop(&st, i);
+            }
+
+            if (pfd[0].revents & POLLIN)
+            {
+                int s = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+
+                if (s >= 0)
+                    st.layers[st.nlayers++] = (struct layer){ .sock = s };
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (ts_before(&now, &next))
+            continue;
+
+        // Tick: pick up new commits, composite and send only on a change
+        for (int i = 0; i < st.nlayers; ++i)
+            if (st.layers[i].shm)
+                dirty |= layer_snapshot(&st.layers[i]);
+        if (dirty)
+        {
+            composite(&st);
+            strip_write(&st);
+            dirty = 0;
+        }
+
+        ts_add_ns(&next, period);
+        // Fell more than a period behind, don't try to catch up
+        if (ts_before(&next, &now))
+        {
+            next = now;
+            ts_add_ns(&next, period);
+        }
+    }
+
+    while (st.nlayers > 0)
+        layer_drop(&st, st.nlayers - 1);
+    close(ls);
+    unlink(path);
+    close(st.fd);
+    free(st.acc);
+    free(st.frame);
+
+    return 0;
+}
+
+// ----- CLIENT -----
+// A fill, or with chase a single dot moving along the layer
+int run_client(const char *path, const char *name, uint32_t start, uint32_t count,
+               int32_t z, uint8_t alpha, int chase, uint32_t fps, uint32_t rgb)
+{
+    struct ledlayer *l;
+    struct timespec tick = { 0, 1000000000L / fps };
+    uint32_t pos = 0;
+    int sock;
+
+    if ((l = ledlayer_open(path, name, start, count, z, alpha, &sock)) == NULL)
+        FAIL("[LIGHT] ERROR: can't get a layer");
+
+    ledlayer_begin(l);
+    for (uint32_t i = 0; i < count; ++i)
+        ledlayer_set(l, i, rgb, chase ? (i == 0 ? 255 : 0) : 255);
+    ledlayer_commit(l);
+
+    while (!stop)
+    {
+        if (!chase)
+        {
+            pause();
+            continue;
+        }
+        nanosleep(&tick, NULL);
+
+        // Only the two pixels that change are written
+        ledlayer_begin(l);
+        ledlayer_set(l, pos, rgb, 0);
+        pos = (pos + 1) % count;
+        ledlayer_set(l, pos, rgb, 255);
+        ledlayer_commit(l);
+    }
+
+    munmap(l, ledlayer_size(count));
+    close(sock);
+
+    return 0;
+}
+
+// ----- PROGRAM -----
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -d /dev/ledstrip-X [-n leds] [-r fps] [-S socket]\n"
+                    "       %s -c name [-S socket] [-s start] [-n count] [-z z] [-a alpha] [-m] RRGGBB\n",
+            prog, prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL, *path = LEDLAYER_SOCKET, *client = NULL;
+    uint32_t leds = 0, fps = FPS, start = 0, alpha = 255;
+    int32_t z = 0;
+    int opt, chase = 0;
+    struct sigaction sa = { .sa_handler = on_signal };
+
+    while ((opt = getopt(argc, argv, "d:n:r:S:c:s:z:a:m")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'n': leds = strtoul(optarg, NULL, 0); break;
+        case 'r': fps = strtoul(optarg, NULL, 0); break;
+        case 'S': path = optarg; break;
+        case 'c': client = optarg; break;
+        case 's': start = strtoul(optarg, NULL, 0); break;
+        case 'z': z = strtol(optarg, NULL, 0); break;
+        case 'a': alpha = strtoul(optarg, NULL, 0); break;
+        case 'm': chase = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (fps == 0 || fps > FPS_MAX || alpha > 255)
+        usage(argv[0]);
+
+    // Not SA_RESTART, ppoll() and pause() have to return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (client)
+    {
+        if (optind >= argc || leds == 0)
+            usage(argv[0]);
+        return run_client(path, client, start, leds, z, alpha, chase, fps,
+                          strtoul(argv[optind], NULL, 16));
+    }
+    if (device == NULL)
+        usage(argv[0]);
+
+    return run_daemon(device, path, leds, fps);
+}
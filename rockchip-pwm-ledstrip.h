@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+/*
+ * Userspace interface for the Rockchip PWM SK6812 LEDSTRIP driver
+ * (rockchip-pwm-mod.c). Each PWM channel driving a strip registers a
+ * misc device, /dev/ledstrip-<pwm device name>.
+ *
+ * Frames are strip length * 3 bytes in R, G, B order; the driver reorders
+ * to the wire order of the strip. A frame is either write()n to the device
+ * or submitted with LEDSTRIP_IOC_SET_FRAME. A frame of strip length * 3
+ * native endian __u16 values carries 16 bits per channel. The driver
+ * corrects it and temporally dithers the result down to the 8 bits on the
+ * wire, refreshing at the dither_fps sysfs rate for as long as any output
+ * level falls between two wire levels.
+ *
+ * The strip length, protocol and colour order come from the device tree
+ * ("rockchip,ledstrip-leds", "rockchip,ledstrip-protocol" and
+ * "rockchip,ledstrip-color-order") and can be changed with
+ * LEDSTRIP_IOC_SET_CONFIG, up to the "rockchip,ledstrip-max-leds" the
+ * driver allocated for. Changing them blanks the strip and discards any
+ * queued frames.
+ *
+ * By default the newest frame wins. The queue_policy sysfs attribute of
+ * the PWM device can instead queue frames so each one is shown: "block"
+ * makes writers wait for space (EAGAIN with O_NONBLOCK), "drop-oldest"
+ * and "drop-newest" discard a frame and count it in queue_drops. Writers
+ * waiting when the policy changes carry on under the new one; switching
+ * back to "latest" drops, and counts, whatever is still queued.
+ *
+ * LEDSTRIP_IOC_SET_RANGE updates a run of LEDs of the last 8-bit frame in
+ * place. Updates arriving faster than the strip refreshes are merged and
+ * go out together on the next refresh.
+ *
+ * LEDSTRIP_IOC_SET_EFFECT hands the strip to the in-kernel effects engine,
+ * which renders frames itself at the requested rate. Submitted frames are
+ * overwritten on the next rendered frame until the effect is set back to
+ * LEDSTRIP_EFFECT_OFF.
+ *
+ * LEDSTRIP_IOC_SET_CORRECTION loads the colour correction applied to every
+ * frame on its way to the wire. It is folded into the driver's encode
+ * table, so it adds no per-pixel work.
+ *
+ * LEDSTRIP_IOC_LOAD_SLOTS stores 8-bit frames in numbered slots, encoded
+ * once on upload. LEDSTRIP_IOC_SHOW_SLOT puts one slot on the strip and
+ * LEDSTRIP_IOC_PLAY steps through a run of slots at a fixed rate, with no
+ * further work from userspace. While a slot is shown, submitted frames
+ * are still taken from the queue, so writers do not block, but not sent;
+ * the most recent one is kept and LEDSTRIP_IOC_SHOW_SLOT with
+ * LEDSTRIP_SLOT_NONE goes back to it. Changing the strip configuration empties the slots.
+ *
+ * LEDSTRIP_IOC_GET_STATUS tells when frames went out: each frame that
+ * becomes the newest (after any queue) is numbered, and the status holds
+ * the number and CLOCK_MONOTONIC times of the last one sent. Frames
+ * overtaken before a refresh never go out, so numbers can be skipped.
+ *
+ * LEDSTRIP_IOC_SET_FRAME_AT submits a frame to be shown at a given time:
+ * the driver starts sending it so that the strip latches it on the
+ * target, and the status reports when it actually latched. Strips on
+ * different controllers line up to the accuracy of their clocks, with
+ * CLOCK_TAI for controllers disciplined to a common PTP time. The frame
+ * is held back, not queued: with the default policy a newer frame still
+ * replaces it; the queue policies show each frame at its time in turn.
+ */
+
+#ifndef _ROCKCHIP_PWM_LEDSTRIP_H
+#define _ROCKCHIP_PWM_LEDSTRIP_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define LEDSTRIP_IOC_MAGIC		'L'
+
+/*
+ * @pixels: user pointer to the R, G, B bytes of a complete frame
+ * @len: length of @pixels in bytes, the strip length * 3 for 8-bit
+ *	 frames or * 6 for 16-bit frames
+ */
+struct ledstrip_frame {
+	__u64 pixels;
+	__u32 len;
+	__u32 reserved;
+};
+
+/*
+ * @pixels, @len: as for struct ledstrip_frame
+ * @clock: CLOCK_MONOTONIC or CLOCK_TAI
+ * @present_ns: time on @clock for the strip to latch the frame, no more
+ *	than 60 s ahead (-EINVAL otherwise)
+ */
+struct ledstrip_timed_frame {
+	__u64 pixels;
+	__u32 len;
+	__u32 clock;
+	__u64 present_ns;
+};
+
+/*
+ * @pixels: user pointer to the R, G, B bytes of LEDs [start, start + count)
+ * @start: first LED to update
+ * @count: number of LEDs, @pixels holds count * 3 bytes
+ */
+struct ledstrip_range {
+	__u64 pixels;
+	__u32 start;
+	__u32 count;
+};
+
+enum ledstrip_protocol {
+	LEDSTRIP_PROTO_SK6812 = 0,	/* 1.2us bit period */
+	LEDSTRIP_PROTO_WS2812B,		/* 1.25us bit period */
+};
+
+/*
+ * @leds: strip length
+ * @max_leds: longest strip the driver has buffers for, ignored on set
+ * @protocol: one of enum ledstrip_protocol
+ * @order: wire order of the colour channels, as indices into R, G, B;
+ *	   { 1, 0, 2 } sends G, R, B
+ */
+struct ledstrip_config {
+	__u32 leds;
+	__u32 max_leds;
+	__u32 protocol;
+	__u8 order[3];
+	__u8 reserved;
+};
+
+#define LEDSTRIP_SLOTS		64
+#define LEDSTRIP_SLOT_NONE	0xffffffff
+
+/*
+ * @pixels: user pointer to @count frames of strip length * 3 bytes each
+ * @first: slot of the first frame, the rest go to the slots after it
+ * @count: number of frames
+ */
+struct ledstrip_slots {
+	__u64 pixels;
+	__u32 first;
+	__u32 count;
+};
+
+/*
+ * @first: slot of the first frame
+ * @count: number of slots played, 0 stops playback on the current slot
+ * @fps: frames per second
+ * @loops: times through the sequence, 0 loops until stopped; playback
+ *	   stops on the last frame
+ */
+struct ledstrip_sequence {
+	__u32 first;
+	__u32 count;
+	__u32 fps;
+	__u32 loops;
+};
+
+/*
+ * Times are CLOCK_MONOTONIC in ns.
+ *
+ * @published: number of the newest frame, frames are numbered from 1
+ * @sent: number of the last frame that went out on the wire, 0 for none
+ * @published_ns: when frame @sent became the newest
+ * @sent_ns: when frame @sent was completely on the wire
+ * @refreshes: frames put on the wire, including repeats and slots
+ * @target_ns: target latch time of frame @sent, 0 if it had none
+ * @present_ns: when the strip latched frame @sent
+ */
+struct ledstrip_status {
+	__u64 published;
+	__u64 sent;
+	__u64 published_ns;
+	__u64 sent_ns;
+	__u64 refreshes;
+	__u64 target_ns;
+	__u64 present_ns;
+};
+
+enum ledstrip_effect_mode {
+	LEDSTRIP_EFFECT_OFF = 0,	/* frames come from userspace */
+	LEDSTRIP_EFFECT_STATIC,		/* uniform colors[0] */
+	LEDSTRIP_EFFECT_GRADIENT,	/* colors[0] to colors[1] along the strip */
+	LEDSTRIP_EFFECT_RAINBOW,	/* full-saturation hue wheel */
+};
+
+/*
+ * @mode: one of enum ledstrip_effect_mode
+ * @colors: 0xRRGGBB
+ * @speed: pattern cycles per minute, 0 holds the pattern still; must be
+ *	below 60 * fps, i.e. under one cycle per rendered frame
+ * @direction: >= 0 moves towards the end of the strip, < 0 towards the start
+ * @fps: render rate in frames per second, 0 keeps the current rate
+ */
+struct ledstrip_effect {
+	__u32 mode;
+	__u32 colors[2];
+	__u32 speed;
+	__s32 direction;
+	__u32 fps;
+};
+
+/*
+ * Output level = gamma[input] * white_balance[channel] * brightness / 255^2
+ *
+ * @gamma: input level to output level, identity by default
+ * @white_balance: R, G, B scale, 255 is unity
+ * @brightness: global scale, 255 is unity
+ */
+struct ledstrip_correction {
+	__u8 gamma[256];
+	__u8 white_balance[3];
+	__u8 brightness;
+};
+
+#define LEDSTRIP_IOC_SET_FRAME	_IOW(LEDSTRIP_IOC_MAGIC, 0x00, struct ledstrip_frame)
+#define LEDSTRIP_IOC_SET_EFFECT	_IOW(LEDSTRIP_IOC_MAGIC, 0x01, struct ledstrip_effect)
+#define LEDSTRIP_IOC_GET_EFFECT	_IOR(LEDSTRIP_IOC_MAGIC, 0x02, struct ledstrip_effect)
+#define LEDSTRIP_IOC_SET_CORRECTION _IOW(LEDSTRIP_IOC_MAGIC, 0x03, struct ledstrip_correction)
+#define LEDSTRIP_IOC_GET_CORRECTION _IOR(LEDSTRIP_IOC_MAGIC, 0x04, struct ledstrip_correction)
+#define LEDSTRIP_IOC_SET_RANGE	_IOW(LEDSTRIP_IOC_MAGIC, 0x05, struct ledstrip_range)
+#define LEDSTRIP_IOC_SET_CONFIG	_IOW(LEDSTRIP_IOC_MAGIC, 0x06, struct ledstrip_config)
+#define LEDSTRIP_IOC_GET_CONFIG	_IOR(LEDSTRIP_IOC_MAGIC, 0x07, struct ledstrip_config)
+#define LEDSTRIP_IOC_LOAD_SLOTS	_IOW(LEDSTRIP_IOC_MAGIC, 0x08, struct ledstrip_slots)
+#define LEDSTRIP_IOC_SHOW_SLOT	_IOW(LEDSTRIP_IOC_MAGIC, 0x09, __u32)
+#define LEDSTRIP_IOC_PLAY	_IOW(LEDSTRIP_IOC_MAGIC, 0x0a, struct ledstrip_sequence)
+#define LEDSTRIP_IOC_GET_STATUS	_IOR(LEDSTRIP_IOC_MAGIC, 0x0b, struct ledstrip_status)
+#define LEDSTRIP_IOC_SET_FRAME_AT _IOW(LEDSTRIP_IOC_MAGIC, 0x0c, struct ledstrip_timed_frame)
+
+#endif /* _ROCKCHIP_PWM_LEDSTRIP_H */
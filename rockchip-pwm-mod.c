@@ -6,24 +6,52 @@
  * Copyright (C) 2014 ROCKCHIP, Inc.
  */
 
+#include <linux/atomic.h>
+#include <linux/bitmap.h>
 #include <linux/clk.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/irq.h>
+#include <linux/kfifo.h>
+#include <linux/kref.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/pinctrl/consumer.h>
 #include <linux/platform_device.h>
+#include <linux/pm_runtime.h>
 #include <linux/pwm.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
+#include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
 
 #include <linux/device.h> 
 #include <linux/sysfs.h>
 #include <linux/string.h>
 #include <linux/delay.h>
 
+#include "ledstrip-dither.h"
+#include "ledstrip-tribuf.h"
 #include "pwm-rockchip.h"
+#include "rockchip-pwm-ledstrip.h"
+#include "sk6812.h"
 
 // -------- PWM ROCKCHIP --------
 #define PWM_MAX_CHANNEL_NUM		4
@@ -52,15 +80,230 @@
 
 #define PWM_CH_INT(n)			BIT(n)
 
+#define PWM_RECIP_SHIFT			32 // fraction bits of the ns/tick multipliers
+
 // -------- SK6812 Spec. Values --------
-#define LED_BITS				24
-#define LEDS					57 // total 1368 bits per 57 LED strip
-#define T0H                     400 // Duty cycle high / low for 0
-#define T0L                     800  
-#define T1H                     800 // Duty cycle high / low for 1
-#define T1L                     400
-#define FPWM                    (T0H + T0L) // PWM frequency (period)
-#define RST                     50000 // min. reset value
+#define LED_BITS				SK6812_LED_BITS
+#define LEDS_DEFAULT			57 // total 1368 bits per 57 LED strip
+#define LEDS_MAX				8192 // ~10ms on the wire at 1.2us a bit
+#define T0H                     SK6812_T0H // Duty cycle high / low for 0
+#define T0L                     SK6812_T0L
+#define T1H                     SK6812_T1H // Duty cycle high / low for 1
+#define T1L                     SK6812_T1L
+#define FPWM                    SK6812_FPWM // PWM frequency (period)
+#define RST                     SK6812_RST // min. reset value
+#define LATCH_US				15000 // hold low after a frame so it latches
+#define STRIP_POLARITY			PWM_POLARITY_NORMAL // duty is the high time, the line rests low
+#define DUTY_IDLE				0 // with STRIP_POLARITY, holds the line low between chunks and for the latch
+
+// -------- MMIO Chunking --------
+#define CHUNK_LEDS_DEFAULT		8 // LEDs per interrupts-off window, ~230us
+#define CHUNK_GAP_NS			(RST / 2) // longest stretch of a low period, well inside RST
+#define CHUNK_RETRIES			3 // frame restarts after a stall
+#define PACE_SPINS				10000 // counter reads before it counts as stopped, ~1ms
+
+#define AUTOSUSPEND_MS			1000 // idle time before the clocks are gated
+#define RATE_CHANGE_MS			50 // longest a frame waits out a PWM clock rate change
+
+// -------- Scheduled Presentation --------
+#define PRESENT_WAKE_NS			(2 * NSEC_PER_MSEC) // wake ahead of a timed frame to resume and encode
+#define PRESENT_SPIN_NS			(50 * NSEC_PER_USEC) // last stretch before the start, spun
+#define PRESENT_HORIZON_NS		(60 * NSEC_PER_SEC) // furthest target accepted
+
+// -------- Frame Buffers --------
+#define LED_BYTES				3 // R, G, B per LED in submitted frames
+#define COLOR_BITS				8
+#define COLOR_LEVELS			256
+#define FRAME_BUFS				LEDSTRIP_TRIBUF_BUFS
+#define ENCODE_CHUNK_LEDS		64 // LEDs encoded between reschedule points
+#define DITHER_FPS_DEFAULT		100 // refresh rate of a deep frame left on the strip
+
+/*
+ * A frame is either 8 bits per channel in @rgb, or 16 bits per channel in
+ * @rgb16 (@deep), which is temporally dithered down on every refresh.
+ * All buffers hold pc->leds_max LEDs, of which pc->leds are in use.
+ *
+ * 8-bit frames are encoded into @duty by the producer as it publishes
+ * them, under frame_mutex but never under frame_lock: the changed LEDs are
+ * copied into @rgb and marked in @stale, and just those re-encoded, as
+ * long as @duty is @encoded with the encode table of @lut_seq; otherwise
+ * all are. The transmitter encodes again only what an encode table
+ * rebuilt since @lut_seq left stale. @stale belongs to whichever side owns
+ * the buffer.
+ */
+struct rockchip_pwm_frame {
+	u8 *rgb;
+	u16 *rgb16;
+	bool deep;
+	bool encoded;
+	unsigned int lut_seq;
+	u32 *duty;
+	unsigned long *stale;
+	u64 seq;		/* publish order, see struct ledstrip_status */
+	u64 published_ns;
+	u64 target_ns;		/* CLOCK_MONOTONIC latch time, 0 for now */
+};
+
+/* Bit timings of the supported LED protocols, see enum ledstrip_protocol */
+struct rockchip_pwm_protocol {
+	const char *name;
+	u32 t0h;	/* high time of a 0, ns */
+	u32 t1h;	/* high time of a 1, ns */
+	u32 period;	/* bit period, ns */
+};
+
+static const struct rockchip_pwm_protocol rockchip_pwm_protocols[] = {
+	[LEDSTRIP_PROTO_SK6812] = { "sk6812", T0H, T1H, FPWM },
+	[LEDSTRIP_PROTO_WS2812B] = { "ws2812b", 400, 800, 1250 },
+};
+
+/* Default wire order of the colour channels, as indices into R, G, B */
+static const u8 rockchip_pwm_wire_order[LED_BYTES] = SK6812_WIRE_ORDER;
+
+// -------- Frame Queue --------
+#define QUEUE_DEPTH				16 // frames, power of two
+
+/* What a full queue does with one more submitted frame */
+enum rockchip_pwm_queue_policy {
+	QUEUE_LATEST,		/* no queue, the newest frame wins */
+	QUEUE_BLOCK,		/* writer waits, -EAGAIN if O_NONBLOCK */
+	QUEUE_DROP_OLDEST,	/* oldest queued frame is discarded */
+	QUEUE_DROP_NEWEST,	/* submitted frame is discarded */
+};
+
+static const char * const rockchip_pwm_queue_policies[] = {
+	[QUEUE_LATEST] = "latest",
+	[QUEUE_BLOCK] = "block",
+	[QUEUE_DROP_OLDEST] = "drop-oldest",
+	[QUEUE_DROP_NEWEST] = "drop-newest",
+};
+
+/* A submitted frame waiting in the queue, 8 or 16 bits per channel */
+struct rockchip_pwm_qframe {
+	u32 len;
+	u64 target_ns;
+	u8 pixels[];
+};
+
+static int tx_cpu = -1;
+module_param(tx_cpu, int, 0444);
+MODULE_PARM_DESC(tx_cpu, "CPU to bind transmit threads to, -1 for any (overridden by rockchip,ledstrip-cpu)");
+
+// -------- Effects Engine --------
+#define FX_FPS_DEFAULT			60
+#define FX_FPS_MAX				200
+
+/*
+ * Effect state, guarded by frame_lock. The phase is a 0.32 fixed-point
+ * fraction of one pattern cycle; the top 16 bits are used for rendering.
+ * fx_timer only paces the effect: the transmit thread renders a snapshot
+ * of this state into fx_buf outside any lock, then stages the result.
+ */
+struct rockchip_pwm_effect {
+	struct ledstrip_effect params;
+	u8 colors[2][LED_BYTES];
+	u32 phase;
+	u32 step;
+	ktime_t interval;
+};
+
+/* "rockchip,ledstrip-boot-effect" names, see enum ledstrip_effect_mode */
+static const char * const rockchip_pwm_fx_names[] = {
+	[LEDSTRIP_EFFECT_OFF] = "off",
+	[LEDSTRIP_EFFECT_STATIC] = "static",
+	[LEDSTRIP_EFFECT_GRADIENT] = "gradient",
+	[LEDSTRIP_EFFECT_RAINBOW] = "rainbow",
+};
+
+// -------- Frame Slots --------
+#define SLOT_FRESH				BIT(16) // set in slot_show until the slot is sent
+#define SEQ_FPS_MAX				200
+
+/* An uploaded frame, its duty words followed by its R, G, B bytes */
+struct rockchip_pwm_slot {
+	unsigned int leds;
+	unsigned int lut_seq;	/* of the encode table @duty was encoded with */
+	u8 *rgb;
+	u32 duty[];
+};
+
+/*
+ * Sequence player state, only touched by seq_timer while it runs. The
+ * timer is started and cancelled under tx_lock.
+ */
+struct rockchip_pwm_seq {
+	struct ledstrip_sequence params;
+	unsigned int pos;
+	unsigned int loop;
+	ktime_t interval;
+};
+
+struct rockchip_pwm_chip;
+
+/*
+ * What open files of the strip device hold on to. The chip and its
+ * buffers are device-managed and go away on remove, this outlives them:
+ * @pc is cleared under @lock for write, and every file operation runs
+ * with @lock held for read and fails with -ENODEV once @pc is NULL.
+ */
+struct rockchip_pwm_strip_ref {
+	struct kref ref;
+	struct rw_semaphore lock;
+	struct rockchip_pwm_chip *pc;
+};
+
+/*
+ * Transmit backends: each one gets a frame already encoded as one duty
+ * word per bit in pc->tx_buf, with the channel running continuously at
+ * FPWM, and returns once the frame has latched.
+ *
+ * @init: optional, claim resources; may set up pc->tx_buf itself
+ * @exit: optional, release what @init claimed
+ * @transmit: send @len duty words
+ * @no_pwm: output does not go through the PWM channel, leave it alone
+ */
+struct rockchip_pwm_tx_backend {
+	const char *name;
+	bool no_pwm;
+	int (*init)(struct rockchip_pwm_chip *pc);
+	void (*exit)(struct rockchip_pwm_chip *pc);
+	int (*transmit)(struct rockchip_pwm_chip *pc, const u32 *duty,
+			unsigned int len);
+};
+
+/*
+ * Channel registers as last written. Everything that writes ctrl, period
+ * or duty keeps this in sync, so state reads are memory loads and writes
+ * of unchanged values are skipped. @period_ns and @duty_ns are the
+ * registers converted back to ns for get_state; @period_req and
+ * @duty_req the last requested ns values, to skip converting them again.
+ */
+struct rockchip_pwm_shadow {
+	u32 ctrl;
+	u32 period;
+	u32 duty;
+	u64 period_ns;
+	u64 duty_ns;
+	u64 period_req;
+	u64 duty_req;
+	bool int_en;	/* this channel's bit of the shared INT_EN register */
+};
+
+/*
+ * Interrupt-paced backend: the run of duty words still to be sent, and
+ * the next burst, worked out ahead so the interrupt only has to arm it
+ */
+struct rockchip_pwm_paced {
+	const u32 *duty;
+	unsigned int len;
+	unsigned int pos;
+	u32 ctrl;
+	bool next_valid;
+	u32 next_ctrl;
+	u32 next_duty;
+	u32 last_duty;	/* of the burst armed last */
+	bool done;	/* frame out, for the interrupt thread to complete */
+};
 
 struct rockchip_pwm_chip {
 	struct pwm_chip chip;
@@ -69,21 +312,165 @@ struct rockchip_pwm_chip {
 	struct pinctrl *pinctrl;
 	struct pinctrl_state *active_state;
 	const struct rockchip_pwm_data *data;
+	const struct rockchip_pwm_hw_ops *hw;	/* data->ops */
 	void __iomem *base;
+	phys_addr_t phys_base;
 	unsigned long clk_rate;
+	u32 tick_mult;	/* ticks per ns, 0.32 fixed point */
+	u64 ns_mult;	/* ns per tick, 32.32 fixed point */
+	struct notifier_block clk_nb;
+	bool rate_changing;	/* between PRE and POST/ABORT_RATE_CHANGE */
+	wait_queue_head_t rate_wait;
 	bool vop_pwm_en; /* indicate voppwm mirror register state */
+	struct rockchip_pwm_shadow shadow;
 	bool center_aligned;
 	bool oneshot;
+	bool pm_boot_ref; /* runtime PM reference for a channel found running */
 	int channel_id;
 	int irq;
 	//int hex_start;
 	//int hex_end;
+
+	/*
+	 * Strip geometry, from DT at probe or LEDSTRIP_IOC_SET_CONFIG. All
+	 * buffers are sized for leds_max; leds, proto and wire_order only
+	 * change with frame_mutex, tx_lock and frame_lock held.
+	 */
+	unsigned int leds;
+	unsigned int leds_max;
+	const struct rockchip_pwm_protocol *proto;
+	u8 wire_order[LED_BYTES];
+
+	/*
+	 * Triple buffer between frame producers and the transmitter (see
+	 * ledstrip-tribuf.h): taking a frame is one atomic exchange, so the
+	 * transmitter never waits on a producer for it and always sees a
+	 * complete frame. Producers serialise among themselves on
+	 * frame_mutex, which makes the back buffer theirs to encode into, and
+	 * take frame_lock only to copy and hand over; the transmitter only
+	 * takes it for short bookkeeping (status, the target of the next
+	 * frame, effect state), never around a frame copy. frame_idx.front is
+	 * under tx_lock.
+	 */
+	struct rockchip_pwm_frame frames[FRAME_BUFS];
+	struct mutex frame_mutex;
+	spinlock_t frame_lock;
+	struct ledstrip_tribuf frame_idx;
+	u64 frame_seq;			/* under frame_lock */
+	u64 tx_seq;			/* frame being sent, 0 for a slot */
+	u64 tx_target;			/* its target latch time, 0 for none */
+	bool tx_held;			/* it was taken too early, wait for it */
+	ktime_t tx_latched;		/* backend: when the strip latches it */
+	u64 tx_overhead_ns;		/* wire time beyond the bit periods */
+
+	/*
+	 * Staging frame: the latest 8-bit content, which producers write
+	 * instead of a whole buffer. frame_dirty[i] marks the LEDs buffer i
+	 * has not caught up with yet, so publishing copies only those. Both
+	 * under frame_lock.
+	 */
+	u8 *stage;
+	unsigned long *frame_dirty[FRAME_BUFS];
+
+	/*
+	 * Frame queue in front of the triple buffer, drained one frame per
+	 * refresh by the transmit thread, unless the policy is QUEUE_LATEST.
+	 */
+	DECLARE_KFIFO(queue, struct rockchip_pwm_qframe *, QUEUE_DEPTH);
+	spinlock_t queue_lock;
+	wait_queue_head_t queue_wait;
+	unsigned int queue_policy;
+	unsigned long queue_drops;	/* under queue_lock */
+
+	struct mutex tx_lock;
+	struct task_struct *tx_thread;
+	wait_queue_head_t tx_wait;
+	bool tx_suspended;	/* system sleep, under tx_lock */
+	bool tx_resend;		/* send the current frame again */
+	struct miscdevice miscdev;
+	struct rockchip_pwm_strip_ref *strip_ref;
+	bool gone;		/* removed, blocked writers bail out */
+
+	struct rockchip_pwm_effect fx;
+	struct mutex fx_lock;	/* serialises effect updates */
+	struct hrtimer fx_timer;
+	atomic_t fx_due;	/* a frame to render, set by fx_timer */
+	u8 *fx_buf;		/* transmit thread's render target */
+	atomic_t fx_boot;	/* boot effect runs until the first frame */
+
+	/*
+	 * Frame slots, encoded on upload; replaced and freed under tx_lock.
+	 * slot_show is 0 while submitted frames are shown, otherwise the
+	 * shown slot + 1, with SLOT_FRESH until the transmitter takes it.
+	 */
+	struct rockchip_pwm_slot *slots[LEDSTRIP_SLOTS];
+	atomic_t slot_show;
+	struct rockchip_pwm_seq seq;
+	struct hrtimer seq_timer;
+
+	/*
+	 * Encode table: for each R, G, B channel and input level, the duty
+	 * words of the corrected output level, MSB first. Gamma, brightness
+	 * and white balance are folded in when the table is built, so the
+	 * encode pass is one copy per colour byte. Rebuilt under tx_lock
+	 * when the correction or the duty timings change; lut_seq tells
+	 * frames and slots encoded with an older table.
+	 *
+	 * Deep frames are corrected before they are dithered, through @corr:
+	 * the same correction in 8.8 fixed point, with one extra entry to
+	 * interpolate against. Their dithered output levels are then encoded
+	 * with @lut_out, which applies no correction.
+	 */
+	u32 (*lut)[COLOR_LEVELS][COLOR_BITS];
+	u16 (*corr)[COLOR_LEVELS + 1];
+	u32 (*lut_out)[COLOR_BITS];
+	seqcount_mutex_t lut_seq;
+	struct ledstrip_correction correction;
+	u32 d0, d1;
+
+	/*
+	 * Temporal dithering of deep frames: per-channel quantisation error
+	 * of the output level (0.8 fixed point, one u16 lane each) carried to
+	 * the next refresh, and the 8-bit output levels of the current
+	 * refresh. Refreshes repeat at dither_fps while any output level has
+	 * a fraction left, and stop once none has. Transmitter only.
+	 */
+	u16 *dither_err;
+	u8 *dither_out;
+	bool dither_active;
+	ktime_t dither_next;
+	unsigned int dither_fps;
+
+	/* Last transmitter-side encode and wire time, for scaling checks */
+	u64 stat_encode_ns;
+	u64 stat_tx_ns;
+	u64 stat_setup_ns;	/* runtime PM and channel start/stop around it */
+	unsigned long stat_stalls;	/* mmio frames resent, under tx_lock */
+	struct ledstrip_status status;	/* under frame_lock */
+
+	/* Transmit backend and the encoded frame it sends */
+	const struct rockchip_pwm_tx_backend *tx;
+	unsigned int chunk_leds;	/* mmio: LEDs per interrupts-off window */
+	u32 *tx_buf;
+	dma_addr_t tx_dma;
+	struct completion tx_done;
+	struct rockchip_pwm_paced paced;
+	struct dma_chan *dma_chan;
+	struct hrtimer sim_timer;
+	struct debugfs_blob_wrapper sim_capture;
+	struct dentry *debugfs;
+	struct spi_device *spi;
+	const struct sk6812_spi_format *spi_format;
+	u8 *spi_buf;
+	size_t spi_len;
 };
 
 /* LEDSTRIP MODES 
-0: static (uniform color, provided by hex, default 0xFF FF FF)
-1: gradient (gradient for 57 LEDs (as macro) between provided colors)
-2: rainbow (oof, we'll see, not for MVP...)
+0: off (frames written by userspace)
+1: static (uniform color, provided by hex)
+2: gradient (gradient along the strip between two provided colors)
+3: rainbow (hue wheel along the strip)
+Rendered in-kernel by the effects engine below, see LEDSTRIP_IOC_SET_EFFECT.
 */
 
 struct rockchip_pwm_regs {
@@ -93,7 +480,25 @@ struct rockchip_pwm_regs {
 	unsigned long ctrl;
 };
 
+/*
+ * Register sequences of one PWM variant, for the paths that run with
+ * interrupts off or once per bit. ROCKCHIP_PWM_VARIANT() instantiates
+ * them from the common bodies for each pwm_data_*, whose lock, polarity
+ * and VOP flags are then constants, so each copy is left with just the
+ * writes its hardware needs.
+ */
+struct rockchip_pwm_hw_ops {
+	void (*config)(struct pwm_chip *chip, struct pwm_device *pwm,
+		       const struct pwm_state *state);
+	int (*enable)(struct pwm_chip *chip, struct pwm_device *pwm,
+		      bool enable);
+	bool (*paced_next)(struct rockchip_pwm_chip *pc);
+	int (*tx_mmio)(struct rockchip_pwm_chip *pc, const u32 *duty,
+		       unsigned int len);
+};
+
 struct rockchip_pwm_data {
+	const struct rockchip_pwm_hw_ops *ops;
 	struct rockchip_pwm_regs regs;
 	unsigned int prescaler;
 	bool supports_polarity;
@@ -108,430 +513,3010 @@ static inline struct rockchip_pwm_chip *to_rockchip_pwm_chip(struct pwm_chip *c)
 	return container_of(c, struct rockchip_pwm_chip, chip);
 }
 
-static void rockchip_pwm_get_state(struct pwm_chip *chip,
-				   struct pwm_device *pwm,
-				   struct pwm_state *state)
+/*
+ * Producer side: returns the back buffer with frame_mutex and frame_lock
+ * held. The caller either fills in a complete deep frame, or updates
+ * pc->stage and marks what changed with rockchip_pwm_stage_mark(), then
+ * hands the frame over with rockchip_pwm_frame_publish(), or backs out
+ * with rockchip_pwm_frame_cancel().
+ */
+static struct rockchip_pwm_frame *
+rockchip_pwm_frame_begin(struct rockchip_pwm_chip *pc, unsigned long *flags)
 {
-	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
-	u32 enable_conf = pc->data->enable_conf;
-	u64 tmp;
-	u32 val;
-	int ret;
+	struct rockchip_pwm_frame *frame;
 
-	ret = clk_enable(pc->pclk);
-	if (ret)
-		return;
+	mutex_lock(&pc->frame_mutex);
+	spin_lock_irqsave(&pc->frame_lock, *flags);
+	frame = &pc->frames[pc->frame_idx.back];
+	frame->target_ns = 0;
 
-	tmp = readl_relaxed(pc->base + pc->data->regs.period);
-	tmp *= pc->data->prescaler * NSEC_PER_SEC;
-	state->period = DIV_ROUND_CLOSEST_ULL(tmp, pc->clk_rate);
+	return frame;
+}
 
-	tmp = readl_relaxed(pc->base + pc->data->regs.duty);
-	tmp *= pc->data->prescaler * NSEC_PER_SEC;
-	state->duty_cycle =  DIV_ROUND_CLOSEST_ULL(tmp, pc->clk_rate);
+static void rockchip_pwm_frame_cancel(struct rockchip_pwm_chip *pc,
+				      unsigned long flags)
+{
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+	mutex_unlock(&pc->frame_mutex);
+}
 
-	//printk(KERN_INFO "[LIGHT] Getting state in driver, current mode: %llu", state->mode);
+/*
+ * Encode @count LEDs from @start of the R, G, B frame @rgb into the duty
+ * words of frame @duty, in wire order. @out_levels: @rgb already holds
+ * corrected output levels, as dithered deep frames do.
+ */
+static void rockchip_pwm_encode(struct rockchip_pwm_chip *pc, const u8 *rgb,
+				u32 *duty, unsigned int start, unsigned int count,
+				bool out_levels)
+{
+	u32 (*lut[LED_BYTES])[COLOR_BITS];
+	int c;
 
-	val = readl_relaxed(pc->base + pc->data->regs.ctrl);
-	state->enabled = (val & enable_conf) == enable_conf;
+	for (c = 0; c < LED_BYTES; c++)
+		lut[c] = out_levels ? pc->lut_out : pc->lut[c];
 
-	if (pc->data->supports_polarity && !(val & PWM_DUTY_POSITIVE))
-		state->polarity = PWM_POLARITY_INVERSED;
-	else
-		state->polarity = PWM_POLARITY_NORMAL;
+	sk6812_encode_lut(rgb + start * LED_BYTES, count, pc->wire_order, lut,
+			  duty + start * LED_BITS);
+}
 
-	clk_disable(pc->pclk);
+/*
+ * Encode @count LEDs from @start, in process context. Long strips take a
+ * while, so encode in chunks and let anything more urgent run in between.
+ */
+static void rockchip_pwm_encode_range(struct rockchip_pwm_chip *pc,
+				      const u8 *rgb, u32 *duty, unsigned int start,
+				      unsigned int count, bool out_levels)
+{
+	unsigned int end = start + count, n;
+
+	for (; start < end; start += n) {
+		n = min_t(unsigned int, end - start, ENCODE_CHUNK_LEDS);
+		rockchip_pwm_encode(pc, rgb, duty, start, n, out_levels);
+		cond_resched();
+	}
 }
 
-static irqreturn_t rockchip_pwm_oneshot_irq(int irq, void *data)
+static void rockchip_pwm_encode_chunked(struct rockchip_pwm_chip *pc,
+					const u8 *rgb, u32 *duty, bool out_levels)
 {
-	struct rockchip_pwm_chip *pc = data;
-	struct pwm_state state;
-	unsigned int id = pc->channel_id;
-	int val;
+	rockchip_pwm_encode_range(pc, rgb, duty, 0, pc->leds, out_levels);
+}
 
-	if (id > 3)
-		return IRQ_NONE;
-	val = readl_relaxed(pc->base + PWM_REG_INTSTS(id));
+/* Producer side, with frame_lock held: the staging frame changed here */
+static void rockchip_pwm_stage_mark(struct rockchip_pwm_chip *pc,
+				    unsigned int start, unsigned int count)
+{
+	int i;
 
-	if ((val & PWM_CH_INT(id)) == 0)
-		return IRQ_NONE;
+	for (i = 0; i < FRAME_BUFS; i++)
+		bitmap_set(pc->frame_dirty[i], start, count);
+}
 
-	writel_relaxed(PWM_CH_INT(id), pc->base + PWM_REG_INTSTS(id));
+/*
+ * Producer side, with frame_lock held: bring @frame up to date with the
+ * staging frame, copying only the LEDs in @dirty and marking them to be
+ * encoded. A copy is short enough for interrupts off; the encode, eight
+ * words per colour byte, is not.
+ */
+static void rockchip_pwm_frame_update(struct rockchip_pwm_chip *pc,
+				      struct rockchip_pwm_frame *frame,
+				      unsigned long *dirty)
+{
+	unsigned int start, end, leds = pc->leds;
 
-	/*
-	 * Set pwm state to disabled when the oneshot mode finished.
-	 */
-	pwm_get_state(&pc->chip.pwms[0], &state);
-	state.enabled = false;
-	pwm_apply_state(&pc->chip.pwms[0], &state);
+	for (start = find_first_bit(dirty, leds); start < leds;
+	     start = find_next_bit(dirty, leds, end)) {
+		end = find_next_zero_bit(dirty, leds, start);
+		memcpy(&frame->rgb[start * LED_BYTES], &pc->stage[start * LED_BYTES],
+		       (end - start) * LED_BYTES);
+	}
+	bitmap_or(frame->stale, frame->stale, dirty, leds);
+	bitmap_zero(dirty, leds);
+}
 
-	rockchip_pwm_oneshot_callback(&pc->chip.pwms[0], &state);
+/*
+ * Bring the duty words of @frame up to date with its R, G, B bytes,
+ * re-encoding only the stale LEDs unless the encode table changed since
+ * it was last encoded. Called by the producer on the back buffer with
+ * frame_mutex held, and by the transmitter on the front one with tx_lock
+ * held.
+ *
+ * Producers read the table without tx_lock. The sequence is read before
+ * the encode, so a table rebuilt during it, or being rebuilt as it
+ * started, leaves @lut_seq behind; the transmitter compares it under
+ * tx_lock, after any rebuild has finished, and encodes the frame again.
+ */
+static void rockchip_pwm_frame_encode(struct rockchip_pwm_chip *pc,
+				      struct rockchip_pwm_frame *frame)
+{
+	unsigned int seq = raw_read_seqcount(&pc->lut_seq);
+	unsigned int start, end, leds = pc->leds;
 
-	return IRQ_HANDLED;
+	if (!frame->encoded || frame->lut_seq != seq)
+		bitmap_fill(frame->stale, leds);
+
+	for (start = find_first_bit(frame->stale, leds); start < leds;
+	     start = find_next_bit(frame->stale, leds, end)) {
+		end = find_next_zero_bit(frame->stale, leds, start);
+		rockchip_pwm_encode_range(pc, frame->rgb, frame->duty, start,
+					  end - start, false);
+	}
+	bitmap_zero(frame->stale, leds);
+
+	frame->lut_seq = seq;
+	frame->encoded = true;
 }
 
-static void rockchip_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
-			       const struct pwm_state *state)
+/*
+ * Hand the back buffer over. An 8-bit frame is encoded here, with
+ * frame_lock dropped, so the encode runs on the producer's CPU while the
+ * transmitter is still sending the frame before; the back buffer stays
+ * ours under frame_mutex. Deep frames are dithered afresh on every
+ * refresh, by the transmitter.
+ */
+static void rockchip_pwm_frame_publish(struct rockchip_pwm_chip *pc,
+				       unsigned long flags)
 {
-	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
-	unsigned long period, duty;
-	unsigned long flags;
-	u64 div;
-	u32 ctrl;
+	struct rockchip_pwm_frame *frame = &pc->frames[pc->frame_idx.back];
 
-	//printk(KERN_INFO "[LIGHT] Configure PWM chip, period is %llu and duty cycle is %llu\n", state->period, state->duty_cycle); /* Note state struct is read-only */
+	if (!frame->deep) {
+		rockchip_pwm_frame_update(pc, frame, pc->frame_dirty[pc->frame_idx.back]);
+		spin_unlock_irqrestore(&pc->frame_lock, flags);
+		rockchip_pwm_frame_encode(pc, frame);
+		spin_lock_irqsave(&pc->frame_lock, flags);
+	}
+	frame->seq = ++pc->frame_seq;
+	frame->published_ns = ktime_get_ns();
 
-	/*
-	 * Since period and duty cycle registers have a width of 32
-	 * bits, every possible input period can be obtained using the
-	 * default prescaler value for all practical clock rate values.
-	 */
-	div = (u64)pc->clk_rate * state->period;
-	period = DIV_ROUND_CLOSEST_ULL(div,
-				       pc->data->prescaler * NSEC_PER_SEC);
+	ledstrip_tribuf_publish(&pc->frame_idx);
+	rockchip_pwm_frame_cancel(pc, flags);
 
-	div = (u64)pc->clk_rate * state->duty_cycle;
-	duty = DIV_ROUND_CLOSEST_ULL(div, pc->data->prescaler * NSEC_PER_SEC);
+	wake_up(&pc->tx_wait);
+}
 
-	local_irq_save(flags);
-	/*
-	 * Lock the period and duty of previous configuration, then
-	 * change the duty and period, that would not be effective.
-	 */
-	ctrl = readl_relaxed(pc->base + pc->data->regs.ctrl);
-	if (pc->data->vop_pwm) {
-		if (pc->vop_pwm_en)
-			ctrl |= PWM_ENABLE;
-		else
-			ctrl &= ~PWM_ENABLE;
+/*
+ * Transmitter side, called with tx_lock held: swaps in the most recently
+ * published frame if there is one, otherwise keeps the current one.
+ */
+static struct rockchip_pwm_frame *
+rockchip_pwm_frame_acquire(struct rockchip_pwm_chip *pc)
+{
+	return &pc->frames[ledstrip_tribuf_acquire(&pc->frame_idx)];
+}
+
+/*
+ * Fill every buffer with @level and forget all encoded and dithered
+ * state. With both tx_lock and frame_lock held, or before either is used.
+ */
+static void rockchip_pwm_frame_reset(struct rockchip_pwm_chip *pc, u8 level)
+{
+	size_t bytes = pc->leds_max * LED_BYTES;
+	int i;
+
+	memset(pc->stage, level, bytes);
+	for (i = 0; i < FRAME_BUFS; i++) {
+		memset(pc->frames[i].rgb, level, bytes);
+		pc->frames[i].deep = false;
+		pc->frames[i].encoded = false;
+		bitmap_zero(pc->frames[i].stale, pc->leds_max);
+		bitmap_zero(pc->frame_dirty[i], pc->leds_max);
 	}
+	memset(pc->dither_err, 0, bytes * sizeof(u16));
+	pc->dither_active = false;
+}
 
-#ifdef CONFIG_PWM_ROCKCHIP_ONESHOT
-	if (state->oneshot_count > PWM_ONESHOT_COUNT_MAX) {
-		pc->oneshot = false;
-		dev_err(chip->dev, "Oneshot_count value overflow.\n");
-	} else if (state->oneshot_count > 0) {
-		u32 int_ctrl;
+static void rockchip_pwm_kvfree(void *p)
+{
+	kvfree(p);
+}
 
-		pc->oneshot = true;
-		ctrl &= ~PWM_ONESHOT_COUNT_MASK;
-		ctrl |= (state->oneshot_count - 1) << PWM_ONESHOT_COUNT_SHIFT;
+/* Managed kvcalloc(), frame buffers of long strips outgrow kmalloc */
+static void *rockchip_pwm_kvcalloc(struct device *dev, size_t n, size_t size)
+{
+	void *p = kvcalloc(n, size, GFP_KERNEL);
 
-		int_ctrl = readl_relaxed(pc->base + PWM_REG_INT_EN(pc->channel_id));
-		int_ctrl |= PWM_CH_INT(pc->channel_id);
-		writel_relaxed(int_ctrl, pc->base + PWM_REG_INT_EN(pc->channel_id));
-	} else {
-		u32 int_ctrl;
+	if (p && devm_add_action_or_reset(dev, rockchip_pwm_kvfree, p))
+		return NULL;
 
-		pc->oneshot = false;
-		ctrl |= PWM_CONTINUOUS;
+	return p;
+}
 
-		int_ctrl = readl_relaxed(pc->base + PWM_REG_INT_EN(pc->channel_id));
-		int_ctrl &= ~PWM_CH_INT(pc->channel_id);
-		writel_relaxed(int_ctrl, pc->base + PWM_REG_INT_EN(pc->channel_id));
+static int rockchip_pwm_frame_init(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	size_t bytes = pc->leds_max * LED_BYTES;
+	int i;
+
+	for (i = 0; i < FRAME_BUFS; i++) {
+		pc->frames[i].rgb = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u8));
+		pc->frames[i].rgb16 = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u16));
+		pc->frames[i].duty = rockchip_pwm_kvcalloc(dev, pc->leds_max * LED_BITS,
+							   sizeof(u32));
+		pc->frames[i].stale = rockchip_pwm_kvcalloc(dev, BITS_TO_LONGS(pc->leds_max),
+							    sizeof(unsigned long));
+		pc->frame_dirty[i] = rockchip_pwm_kvcalloc(dev, BITS_TO_LONGS(pc->leds_max),
+							   sizeof(unsigned long));
+		if (!pc->frames[i].rgb || !pc->frames[i].rgb16 ||
+		    !pc->frames[i].duty || !pc->frames[i].stale ||
+		    !pc->frame_dirty[i])
+			return -ENOMEM;
 	}
-#endif
+	pc->stage = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u8));
+	pc->dither_err = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u16));
+	pc->dither_out = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u8));
+	pc->fx_buf = rockchip_pwm_kvcalloc(dev, bytes, sizeof(u8));
+	if (!pc->stage || !pc->dither_err || !pc->dither_out || !pc->fx_buf)
+		return -ENOMEM;
 
-	if (pc->data->supports_lock) {
-		ctrl |= PWM_LOCK_EN;
-		writel_relaxed(ctrl, pc->base + pc->data->regs.ctrl);
+	/* Power-on frame: all bits set, as the original test pattern */
+	rockchip_pwm_frame_reset(pc, 0xff);
+
+	mutex_init(&pc->frame_mutex);
+	spin_lock_init(&pc->frame_lock);
+	ledstrip_tribuf_init(&pc->frame_idx);
+	pc->dither_fps = DITHER_FPS_DEFAULT;
+
+	return 0;
+}
+
+static inline u8 rockchip_pwm_fx_lerp(u8 a, u8 b, u32 t)
+{
+	/* t is 0.16 fixed point */
+	return a + (((int)b - (int)a) * (int)t >> 16);
+}
+
+static void rockchip_pwm_fx_hue(u8 *rgb, u32 hue)
+{
+	/* hue is 0.16 fixed point, six sectors of the colour wheel */
+	u32 h6 = hue * 6;
+	u8 rise = (h6 >> 8) & 0xff;
+	u8 fall = 0xff - rise;
+
+	switch (h6 >> 16) {
+	case 0: rgb[0] = 0xff; rgb[1] = rise; rgb[2] = 0; break;
+	case 1: rgb[0] = fall; rgb[1] = 0xff; rgb[2] = 0; break;
+	case 2: rgb[0] = 0; rgb[1] = 0xff; rgb[2] = rise; break;
+	case 3: rgb[0] = 0; rgb[1] = fall; rgb[2] = 0xff; break;
+	case 4: rgb[0] = rise; rgb[1] = 0; rgb[2] = 0xff; break;
+	default: rgb[0] = 0xff; rgb[1] = 0; rgb[2] = fall; break;
 	}
+}
 
-	writel(period, pc->base + pc->data->regs.period);
-	writel(duty, pc->base + pc->data->regs.duty);
+/* Render one frame of effect state @fx, which may be a private copy */
+static void rockchip_pwm_fx_render(const struct rockchip_pwm_effect *fx, u8 *rgb,
+				   unsigned int leds)
+{
+	u32 phase = fx->phase >> 16;
+	u32 pos, t;
+	unsigned int i;
+	int c;
+
+	for (i = 0; i < leds; i++, rgb += LED_BYTES) {
+		/* position of this LED along one pattern cycle, 0.16 */
+		pos = ((u64)i * 0x10000 / leds + phase) & 0xffff;
+
+		switch (fx->params.mode) {
+		case LEDSTRIP_EFFECT_STATIC:
+			memcpy(rgb, fx->colors[0], LED_BYTES);
+			break;
+		case LEDSTRIP_EFFECT_GRADIENT:
+			if (fx->step)	/* moving: triangle wave so it wraps cleanly */
+				t = pos < 0x8000 ? pos << 1 : (0xffff - pos) << 1;
+			else
+				t = leds > 1 ? i * 0xffff / (leds - 1) : 0;
+			for (c = 0; c < LED_BYTES; c++)
+				rgb[c] = rockchip_pwm_fx_lerp(fx->colors[0][c],
+							      fx->colors[1][c], t);
+			break;
+		case LEDSTRIP_EFFECT_RAINBOW:
+			rockchip_pwm_fx_hue(rgb, pos);
+			break;
+		}
+	}
+}
 
-	if (pc->data->supports_polarity) {
-		ctrl &= ~PWM_POLARITY_MASK;
-		if (state->polarity == PWM_POLARITY_INVERSED)
-			ctrl |= PWM_DUTY_NEGATIVE | PWM_INACTIVE_POSITIVE;
-		else
-			ctrl |= PWM_DUTY_POSITIVE | PWM_INACTIVE_NEGATIVE;
+/*
+ * Pace the effect: flag a frame for the transmit thread to render. This
+ * runs in hard interrupt context, so it does nothing more.
+ */
+static enum hrtimer_restart rockchip_pwm_fx_tick(struct hrtimer *timer)
+{
+	struct rockchip_pwm_chip *pc =
+		container_of(timer, struct rockchip_pwm_chip, fx_timer);
+	unsigned long flags;
+	ktime_t interval;
+
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	if (pc->fx.params.mode == LEDSTRIP_EFFECT_OFF) {
+		spin_unlock_irqrestore(&pc->frame_lock, flags);
+		return HRTIMER_NORESTART;
 	}
+	interval = pc->fx.interval;
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
 
-	/*
-	 * Unlock and set polarity at the same time,
-	 * the configuration of duty, period and polarity
-	 * would be effective together at next period.
-	 */
-	if (pc->data->supports_lock)
-		ctrl &= ~PWM_LOCK_EN;
+	atomic_set(&pc->fx_due, 1);
+	wake_up(&pc->tx_wait);
 
-	writel(ctrl, pc->base + pc->data->regs.ctrl);
-	local_irq_restore(flags);
+	hrtimer_forward_now(timer, interval);
+
+	return HRTIMER_RESTART;
 }
 
-/* BLK DIAG
-	+-------------------------------------+
-	| External Request (Change PWM Config)|
-	+-------------------------------------+
-						|
-						V
-	+----------------------------------+
-	| rockchip_pwm_apply               |
-	+----------------------------------+
-	1. Enable/Disable PWM clock
-	2. Retrieve Current State 
-	3. Handle Polarity Changes
-	4. **Call rockchip_pwm_config**
-	5. Enable/Disable PWM Output
-	6. Pin Control (If needed)
-						| 
-						V
-	+----------------------------------+
-	| rockchip_pwm_config              |
-	+----------------------------------+
-	1. Calculate Period/Duty Values
-	2. Configure One-Shot (If needed)
-	3. Manage Lock Mechanism (If needed)
-	4. Write to Hardware Registers
-						|
-						V
-	+----------------------------------+
-	| PWM Hardware Registers           |
-	+----------------------------------+
-				(Period, Duty, Polarity, etc.)
-*/
+/*
+ * Transmit thread side: render the frame flagged by fx_tick. The effect
+ * state is snapshotted and advanced under frame_lock, rendered into
+ * fx_buf without it, and only the copy into the staging frame is done
+ * with the lock held again. An effect switched off meanwhile, or a strip
+ * length changed, drops the frame.
+ */
+static void rockchip_pwm_fx_run(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_effect fx;
+	struct rockchip_pwm_frame *frame;
+	unsigned long flags;
+	unsigned int leds;
+
+	if (!atomic_xchg(&pc->fx_due, 0))
+		return;
+
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	fx = pc->fx;
+	leds = pc->leds;
+	/* Patterns travel towards the end of the strip for positive steps */
+	if (fx.params.direction < 0)
+		pc->fx.phase += fx.step;
+	else
+		pc->fx.phase -= fx.step;
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+
+	if (fx.params.mode == LEDSTRIP_EFFECT_OFF)
+		return;
+
+	rockchip_pwm_fx_render(&fx, pc->fx_buf, leds);
+
+	frame = rockchip_pwm_frame_begin(pc, &flags);
+	if (pc->fx.params.mode == LEDSTRIP_EFFECT_OFF || pc->leds != leds) {
+		rockchip_pwm_frame_cancel(pc, flags);
+		return;
+	}
+	memcpy(pc->stage, pc->fx_buf, leds * LED_BYTES);
+	rockchip_pwm_stage_mark(pc, 0, leds);
+	frame->deep = false;
+	rockchip_pwm_frame_publish(pc, flags);
+}
+
+static int rockchip_pwm_fx_set(struct rockchip_pwm_chip *pc,
+			       const struct ledstrip_effect *params)
+{
+	struct rockchip_pwm_effect *fx = &pc->fx;
+	unsigned long flags;
+	u32 fps;
+	int i;
+
+	if (params->mode > LEDSTRIP_EFFECT_RAINBOW || params->fps > FX_FPS_MAX)
+		return -EINVAL;
+
+	mutex_lock(&pc->fx_lock);
+
+	/* under one cycle per rendered frame, so the phase step fits 0.32 */
+	fps = params->fps ? params->fps : fx->params.fps;
+	if (params->speed >= 60 * fps) {
+		mutex_unlock(&pc->fx_lock);
+		return -EINVAL;
+	}
+
+	hrtimer_cancel(&pc->fx_timer);
+
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	fx->params = *params;
+	fx->params.fps = fps;
+	for (i = 0; i < 2; i++) {
+		fx->colors[i][0] = params->colors[i] >> 16;
+		fx->colors[i][1] = params->colors[i] >> 8;
+		fx->colors[i][2] = params->colors[i];
+	}
+	/* cycles per minute to a 0.32 phase increment per rendered frame */
+	fx->step = div_u64((u64)params->speed << 32, 60 * fps);
+	fx->interval = ktime_set(0, NSEC_PER_SEC / fps);
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+
+	if (params->mode != LEDSTRIP_EFFECT_OFF)
+		hrtimer_start(&pc->fx_timer, 0, HRTIMER_MODE_REL);
+
+	mutex_unlock(&pc->fx_lock);
+
+	return 0;
+}
+
+static void rockchip_pwm_fx_init(struct rockchip_pwm_chip *pc)
+{
+	mutex_init(&pc->fx_lock);
+	pc->fx.params.mode = LEDSTRIP_EFFECT_OFF;
+	pc->fx.params.fps = FX_FPS_DEFAULT;
+	pc->fx.interval = ktime_set(0, NSEC_PER_SEC / FX_FPS_DEFAULT);
+	hrtimer_init(&pc->fx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pc->fx_timer.function = rockchip_pwm_fx_tick;
+}
+
+/* Put @slot on the strip at the next refresh */
+static void rockchip_pwm_slot_show(struct rockchip_pwm_chip *pc,
+				   unsigned int slot)
+{
+	atomic_set(&pc->slot_show, (slot + 1) | SLOT_FRESH);
+	wake_up(&pc->tx_wait);
+}
+
+static enum hrtimer_restart rockchip_pwm_seq_tick(struct hrtimer *timer)
+{
+	struct rockchip_pwm_chip *pc =
+		container_of(timer, struct rockchip_pwm_chip, seq_timer);
+	struct rockchip_pwm_seq *seq = &pc->seq;
+
+	rockchip_pwm_slot_show(pc, seq->params.first + seq->pos);
+
+	if (++seq->pos == seq->params.count) {
+		seq->pos = 0;
+		/* a finite sequence holds its last frame */
+		if (seq->params.loops && ++seq->loop == seq->params.loops)
+			return HRTIMER_NORESTART;
+	}
+
+	hrtimer_forward_now(timer, seq->interval);
+
+	return HRTIMER_RESTART;
+}
+
+/* Slots [first, first + count) all hold a frame, called with tx_lock held */
+static bool rockchip_pwm_slots_loaded(struct rockchip_pwm_chip *pc,
+				      unsigned int first, unsigned int count)
+{
+	unsigned int i;
+
+	if (first >= LEDSTRIP_SLOTS || count > LEDSTRIP_SLOTS - first)
+		return false;
+
+	for (i = first; i < first + count; i++)
+		if (!pc->slots[i])
+			return false;
+
+	return true;
+}
+
+/*
+ * Store @req->count frames from userspace in consecutive slots, encoding
+ * each one as it arrives. Encoding is under tx_lock, which the strip
+ * length and the encode table only change under.
+ */
+static int rockchip_pwm_slots_load(struct rockchip_pwm_chip *pc,
+				   const struct ledstrip_slots *req)
+{
+	const u8 __user *pixels = u64_to_user_ptr(req->pixels);
+	unsigned int leds = READ_ONCE(pc->leds);
+	size_t bytes = leds * LED_BYTES;
+	struct rockchip_pwm_slot *slot, *old;
+	unsigned int i;
+
+	if (!req->count || req->first >= LEDSTRIP_SLOTS ||
+	    req->count > LEDSTRIP_SLOTS - req->first)
+		return -EINVAL;
+
+	for (i = 0; i < req->count; i++, pixels += bytes) {
+		slot = kvmalloc(struct_size(slot, duty, leds * LED_BITS) + bytes,
+				GFP_KERNEL);
+		if (!slot)
+			return -ENOMEM;
+
+		slot->leds = leds;
+		slot->rgb = (u8 *)&slot->duty[leds * LED_BITS];
+		if (copy_from_user(slot->rgb, pixels, bytes)) {
+			kvfree(slot);
+			return -EFAULT;
+		}
+
+		mutex_lock(&pc->tx_lock);
+		if (leds != pc->leds) {
+			mutex_unlock(&pc->tx_lock);
+			kvfree(slot);
+			return -EINVAL;
+		}
+		rockchip_pwm_encode_chunked(pc, slot->rgb, slot->duty, false);
+		slot->lut_seq = raw_read_seqcount(&pc->lut_seq);
+		old = pc->slots[req->first + i];
+		pc->slots[req->first + i] = slot;
+		mutex_unlock(&pc->tx_lock);
+
+		kvfree(old);
+	}
+
+	return 0;
+}
+
+/* Show one slot, or go back to submitted frames for LEDSTRIP_SLOT_NONE */
+static int rockchip_pwm_slot_select(struct rockchip_pwm_chip *pc, u32 slot)
+{
+	int ret = 0;
+
+	mutex_lock(&pc->tx_lock);
+	hrtimer_cancel(&pc->seq_timer);
+
+	if (slot == LEDSTRIP_SLOT_NONE) {
+		atomic_set(&pc->slot_show, 0);
+		WRITE_ONCE(pc->tx_resend, true);
+		wake_up(&pc->tx_wait);
+	} else if (rockchip_pwm_slots_loaded(pc, slot, 1)) {
+		rockchip_pwm_slot_show(pc, slot);
+	} else {
+		ret = -ENOENT;
+	}
+	mutex_unlock(&pc->tx_lock);
+
+	return ret;
+}
+
+static int rockchip_pwm_seq_play(struct rockchip_pwm_chip *pc,
+				 const struct ledstrip_sequence *params)
+{
+	struct rockchip_pwm_seq *seq = &pc->seq;
+	int ret = 0;
+
+	if (params->count && (!params->fps || params->fps > SEQ_FPS_MAX))
+		return -EINVAL;
+
+	mutex_lock(&pc->tx_lock);
+	hrtimer_cancel(&pc->seq_timer);
+
+	/* a count of 0 stops on whatever slot is showing */
+	if (!params->count) {
+		ret = 0;
+	} else if (rockchip_pwm_slots_loaded(pc, params->first, params->count)) {
+		seq->params = *params;
+		seq->pos = 0;
+		seq->loop = 0;
+		seq->interval = ktime_set(0, NSEC_PER_SEC / params->fps);
+		hrtimer_start(&pc->seq_timer, 0, HRTIMER_MODE_REL);
+	} else {
+		ret = -ENOENT;
+	}
+	mutex_unlock(&pc->tx_lock);
+
+	return ret;
+}
+
+/* Stop playback and drop every slot, called with tx_lock held */
+static void rockchip_pwm_slots_clear(struct rockchip_pwm_chip *pc)
+{
+	int i;
+
+	hrtimer_cancel(&pc->seq_timer);
+	atomic_set(&pc->slot_show, 0);
+	for (i = 0; i < LEDSTRIP_SLOTS; i++) {
+		kvfree(pc->slots[i]);
+		pc->slots[i] = NULL;
+	}
+}
+
+/*
+ * Duty words of the slot being shown, or NULL when submitted frames are,
+ * called with tx_lock held. A slot encoded before the encode table last
+ * changed is encoded again first.
+ */
+static const u32 *rockchip_pwm_slot_encode(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_slot *slot;
+	int show;
+
+	show = atomic_fetch_andnot(SLOT_FRESH, &pc->slot_show) & ~SLOT_FRESH;
+	if (!show)
+		return NULL;
+
+	slot = pc->slots[show - 1];
+	if (!slot)
+		return NULL;
+
+	if (slot->lut_seq != raw_read_seqcount(&pc->lut_seq)) {
+		rockchip_pwm_encode_chunked(pc, slot->rgb, slot->duty, false);
+		slot->lut_seq = raw_read_seqcount(&pc->lut_seq);
+	}
+
+	return slot->duty;
+}
+
+static void rockchip_pwm_slots_init(struct rockchip_pwm_chip *pc)
+{
+	atomic_set(&pc->slot_show, 0);
+	hrtimer_init(&pc->seq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pc->seq_timer.function = rockchip_pwm_seq_tick;
+}
+
+/*
+ * Precompute the conversions between ns and PWM clock ticks at @rate, so
+ * each one is a multiply and shift. The PWM clock stays below 1 GHz, so
+ * ticks per ns fit in a 0.32 multiplier.
+ */
+static void rockchip_pwm_rate_update(struct rockchip_pwm_chip *pc,
+				     unsigned long rate)
+{
+	u64 ns = (u64)pc->data->prescaler * NSEC_PER_SEC;
+
+	pc->clk_rate = rate;
+	pc->tick_mult = div64_u64((u64)rate << PWM_RECIP_SHIFT, ns);
+	pc->ns_mult = div64_u64(ns << PWM_RECIP_SHIFT, rate);
+}
+
+/* Both round to nearest: one fraction bit more, then round that off */
+static inline u32 rockchip_pwm_ns_to_ticks(struct rockchip_pwm_chip *pc, u64 ns)
+{
+	return (mul_u64_u32_shr(ns, pc->tick_mult, PWM_RECIP_SHIFT - 1) + 1) >> 1;
+}
+
+static inline u64 rockchip_pwm_ticks_to_ns(struct rockchip_pwm_chip *pc, u32 ticks)
+{
+	return (mul_u64_u32_shr(pc->ns_mult, ticks, PWM_RECIP_SHIFT - 1) + 1) >> 1;
+}
+
+static void rockchip_pwm_shadow_period(struct rockchip_pwm_chip *pc, u32 period)
+{
+	if (pc->shadow.period == period)
+		return;
+	pc->shadow.period = period;
+	pc->shadow.period_ns = rockchip_pwm_ticks_to_ns(pc, period);
+}
+
+static void rockchip_pwm_shadow_duty(struct rockchip_pwm_chip *pc, u32 duty)
+{
+	if (pc->shadow.duty == duty)
+		return;
+	pc->shadow.duty = duty;
+	pc->shadow.duty_ns = rockchip_pwm_ticks_to_ns(pc, duty);
+}
+
+/* Seed the shadow from the hardware, called with pclk enabled */
+static void rockchip_pwm_shadow_init(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_shadow *sh = &pc->shadow;
+	u32 int_ctrl;
+
+	sh->ctrl = readl_relaxed(pc->base + pc->data->regs.ctrl);
+	sh->period = readl_relaxed(pc->base + pc->data->regs.period);
+	sh->duty = readl_relaxed(pc->base + pc->data->regs.duty);
+	sh->period_ns = rockchip_pwm_ticks_to_ns(pc, sh->period);
+	sh->duty_ns = rockchip_pwm_ticks_to_ns(pc, sh->duty);
+	sh->period_req = sh->period_ns;
+	sh->duty_req = sh->duty_ns;
+
+	int_ctrl = readl_relaxed(pc->base + PWM_REG_INT_EN(pc->channel_id));
+	sh->int_en = int_ctrl & PWM_CH_INT(pc->channel_id);
+}
+
+/*
+ * Set or clear the channel's interrupt enable. INT_EN is shared by all
+ * channels of the block, so only this channel's bit is shadowed and a
+ * change is still a read-modify-write.
+ */
+static void rockchip_pwm_int_enable(struct rockchip_pwm_chip *pc, bool on)
+{
+	unsigned int id = pc->channel_id;
+	u32 int_ctrl;
+
+	if (pc->shadow.int_en == on)
+		return;
+
+	int_ctrl = readl_relaxed(pc->base + PWM_REG_INT_EN(id));
+	if (on)
+		int_ctrl |= PWM_CH_INT(id);
+	else
+		int_ctrl &= ~PWM_CH_INT(id);
+	writel_relaxed(int_ctrl, pc->base + PWM_REG_INT_EN(id));
+	pc->shadow.int_en = on;
+}
+
+static void rockchip_pwm_get_state(struct pwm_chip *chip,
+				   struct pwm_device *pwm,
+				   struct pwm_state *state)
+{
+	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
+	u32 enable_conf = pc->data->enable_conf;
+	u32 val = pc->shadow.ctrl;
+
+	state->period = pc->shadow.period_ns;
+	state->duty_cycle = pc->shadow.duty_ns;
+
+	//printk(KERN_INFO "[LIGHT] Getting state in driver, current mode: %llu", state->mode);
+
+	state->enabled = (val & enable_conf) == enable_conf;
+
+	if (pc->data->supports_polarity && !(val & PWM_DUTY_POSITIVE))
+		state->polarity = PWM_POLARITY_INVERSED;
+	else
+		state->polarity = PWM_POLARITY_NORMAL;
+}
+
+/* Work out the next run of identical duty words as one oneshot burst */
+static void rockchip_pwm_paced_prepare(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_paced *p = &pc->paced;
+	unsigned int run = 1;
+
+	if (p->pos >= p->len) {
+		p->next_valid = false;
+		return;
+	}
+
+	while (p->pos + run < p->len && run < PWM_ONESHOT_COUNT_MAX &&
+	       p->duty[p->pos + run] == p->duty[p->pos])
+		run++;
+
+	p->next_ctrl = p->ctrl & ~(PWM_ONESHOT_COUNT_MASK | PWM_CONTINUOUS);
+	p->next_ctrl |= (run - 1) << PWM_ONESHOT_COUNT_SHIFT | PWM_ENABLE;
+	p->next_duty = p->duty[p->pos];
+	p->next_valid = true;
+	p->pos += run;
+}
+
+/*
+ * Arm the prepared burst, then prepare the one after it. The channel has
+ * stopped at the end of the previous burst, so arming is two register
+ * writes and each gap between bursts only stretches a low period a
+ * little. Returns false once the frame is out.
+ */
+static __always_inline bool
+__rockchip_pwm_paced_next(struct rockchip_pwm_chip *pc,
+			  const struct rockchip_pwm_data *data)
+{
+	struct rockchip_pwm_paced *p = &pc->paced;
+
+	if (!p->next_valid)
+		return false;
+
+	writel_relaxed(p->next_duty, pc->base + data->regs.duty);
+	writel(p->next_ctrl, pc->base + data->regs.ctrl);
+	p->last_duty = p->next_duty;
+
+	rockchip_pwm_paced_prepare(pc);
+
+	return true;
+}
+
+/*
+ * Hard half of the oneshot interrupt: ack it and, while a paced frame is
+ * going out, arm its next burst straight away. Everything else is left
+ * to rockchip_pwm_oneshot_irq_thread().
+ */
+static irqreturn_t rockchip_pwm_oneshot_irq(int irq, void *data)
+{
+	struct rockchip_pwm_chip *pc = data;
+	unsigned int id = pc->channel_id;
+	int val;
+
+	if (id > 3)
+		return IRQ_NONE;
+	val = readl_relaxed(pc->base + PWM_REG_INTSTS(id));
+
+	if ((val & PWM_CH_INT(id)) == 0)
+		return IRQ_NONE;
+
+	writel_relaxed(PWM_CH_INT(id), pc->base + PWM_REG_INTSTS(id));
+
+	if (READ_ONCE(pc->paced.duty)) {
+		if (pc->hw->paced_next(pc))
+			return IRQ_HANDLED;
+
+		WRITE_ONCE(pc->paced.duty, NULL);
+		WRITE_ONCE(pc->paced.done, true);
+	}
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t rockchip_pwm_oneshot_irq_thread(int irq, void *data)
+{
+	struct rockchip_pwm_chip *pc = data;
+	struct pwm_state state;
+
+	if (READ_ONCE(pc->paced.done)) {
+		WRITE_ONCE(pc->paced.done, false);
+		complete(&pc->tx_done);
+		return IRQ_HANDLED;
+	}
+
+	/*
+	 * Set pwm state to disabled when the oneshot mode finished. Stop the
+	 * channel directly: pwm_apply_state() would end up in ->apply, which
+	 * sends a strip frame under tx_lock. A frame going out owns the
+	 * channel and stops it itself, and tx_irq() may be waiting for this
+	 * thread under tx_lock, so only try the lock. Registers are left
+	 * alone while the block is runtime suspended.
+	 */
+	pwm_get_state(&pc->chip.pwms[0], &state);
+	state.enabled = false;
+	if (mutex_trylock(&pc->tx_lock)) {
+		if (pm_runtime_get_if_in_use(pc->chip.dev) > 0) {
+			pc->hw->enable(&pc->chip, &pc->chip.pwms[0], false);
+			pm_runtime_mark_last_busy(pc->chip.dev);
+			pm_runtime_put_autosuspend(pc->chip.dev);
+		}
+		mutex_unlock(&pc->tx_lock);
+	}
+
+	rockchip_pwm_oneshot_callback(&pc->chip.pwms[0], &state);
+
+	return IRQ_HANDLED;
+}
+
+static __always_inline void
+__rockchip_pwm_config(struct pwm_chip *chip, const struct pwm_state *state,
+		      const struct rockchip_pwm_data *data)
+{
+	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
+	struct rockchip_pwm_shadow *sh = &pc->shadow;
+	u32 period = sh->period, duty = sh->duty;
+	unsigned long flags;
+	bool reload;
+	u32 ctrl;
+
+	//printk(KERN_INFO "[LIGHT] Configure PWM chip, period is %llu and duty cycle is %llu\n", state->period, state->duty_cycle); /* Note state struct is read-only */
+
+	/*
+	 * Since period and duty cycle registers have a width of 32
+	 * bits, every possible input period can be obtained using the
+	 * default prescaler value for all practical clock rate values.
+	 * Only convert what changed since the last request.
+	 */
+	if (state->period != sh->period_req) {
+		period = rockchip_pwm_ns_to_ticks(pc, state->period);
+		sh->period_req = state->period;
+	}
+
+	if (state->duty_cycle != sh->duty_req) {
+		duty = rockchip_pwm_ns_to_ticks(pc, state->duty_cycle);
+		sh->duty_req = state->duty_cycle;
+	}
+
+	reload = period != sh->period || duty != sh->duty;
+
+	local_irq_save(flags);
+	/*
+	 * Lock the period and duty of previous configuration, then
+	 * change the duty and period, that would not be effective.
+	 */
+	ctrl = sh->ctrl;
+	if (data->vop_pwm) {
+		if (pc->vop_pwm_en)
+			ctrl |= PWM_ENABLE;
+		else
+			ctrl &= ~PWM_ENABLE;
+	}
+
+#ifdef CONFIG_PWM_ROCKCHIP_ONESHOT
+	if (state->oneshot_count > PWM_ONESHOT_COUNT_MAX) {
+		pc->oneshot = false;
+		dev_err(chip->dev, "Oneshot_count value overflow.\n");
+	} else if (state->oneshot_count > 0) {
+		pc->oneshot = true;
+		ctrl &= ~PWM_ONESHOT_COUNT_MASK;
+		ctrl |= (state->oneshot_count - 1) << PWM_ONESHOT_COUNT_SHIFT;
+		rockchip_pwm_int_enable(pc, true);
+	} else {
+		pc->oneshot = false;
+		ctrl |= PWM_CONTINUOUS;
+		rockchip_pwm_int_enable(pc, false);
+	}
+#endif
+
+	if (reload) {
+		if (data->supports_lock) {
+			ctrl |= PWM_LOCK_EN;
+			writel_relaxed(ctrl, pc->base + data->regs.ctrl);
+		}
+
+		if (period != sh->period)
+			writel(period, pc->base + data->regs.period);
+		if (duty != sh->duty)
+			writel(duty, pc->base + data->regs.duty);
+		rockchip_pwm_shadow_period(pc, period);
+		rockchip_pwm_shadow_duty(pc, duty);
+	}
+
+	if (data->supports_polarity) {
+		ctrl &= ~PWM_POLARITY_MASK;
+		if (state->polarity == PWM_POLARITY_INVERSED)
+			ctrl |= PWM_DUTY_NEGATIVE | PWM_INACTIVE_POSITIVE;
+		else
+			ctrl |= PWM_DUTY_POSITIVE | PWM_INACTIVE_NEGATIVE;
+	}
+
+	/*
+	 * Unlock and set polarity at the same time,
+	 * the configuration of duty, period and polarity
+	 * would be effective together at next period.
+	 */
+	if (data->supports_lock)
+		ctrl &= ~PWM_LOCK_EN;
+
+	if (reload || ctrl != sh->ctrl) {
+		writel(ctrl, pc->base + data->regs.ctrl);
+		sh->ctrl = ctrl;
+	}
+	local_irq_restore(flags);
+}
+
+/* BLK DIAG
+	+-------------------------------------+
+	| External Request (Change PWM Config)|
+	+-------------------------------------+
+						|
+						V
+	+----------------------------------+
+	| rockchip_pwm_apply               |
+	+----------------------------------+
+	1. Enable/Disable PWM clock
+	2. Retrieve Current State 
+	3. Handle Polarity Changes
+	4. **Call pc->hw->config**
+	5. Enable/Disable PWM Output
+	6. Pin Control (If needed)
+						| 
+						V
+	+----------------------------------+
+	| __rockchip_pwm_config            |
+	+----------------------------------+
+	1. Calculate Period/Duty Values
+	2. Configure One-Shot (If needed)
+	3. Manage Lock Mechanism (If needed)
+	4. Write to Hardware Registers
+						|
+						V
+	+----------------------------------+
+	| PWM Hardware Registers           |
+	+----------------------------------+
+				(Period, Duty, Polarity, etc.)
+*/
+
+static __always_inline int
+__rockchip_pwm_enable(struct pwm_chip *chip, bool enable,
+		      const struct rockchip_pwm_data *data)
+{
+	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
+	u32 enable_conf = data->enable_conf;
+	u32 val;
+
+	//printk(KERN_INFO "[LIGHT] Enable/Disable PWM\n");
+
+	val = pc->shadow.ctrl;
+	val &= ~data->enable_conf_mask;
+
+	if (PWM_OUTPUT_CENTER & data->enable_conf_mask) 
+	{
+		if (pc->center_aligned)
+			val |= PWM_OUTPUT_CENTER;
+	}
+
+	if (enable) {
+		val |= enable_conf;
+		if (pc->oneshot)
+			val &= ~PWM_CONTINUOUS;
+	} else {
+		val &= ~enable_conf;
+	}
+
+	if (val != pc->shadow.ctrl) {
+		writel_relaxed(val, pc->base + data->regs.ctrl);
+		pc->shadow.ctrl = val;
+	}
+	if (data->vop_pwm)
+		pc->vop_pwm_en = enable;
+
+	/* Clocks are runtime PM's from here, once the channel has stopped */
+	if (!enable && pc->pm_boot_ref) {
+		pc->pm_boot_ref = false;
+		pm_runtime_put_noidle(chip->dev);
+	}
+
+	return 0;
+}
+
+static void rockchip_pwm_lut_build(struct rockchip_pwm_chip *pc)
+{
+	const struct ledstrip_correction *cc = &pc->correction;
+	u32 scale, level;
+	int c, v;
+
+	write_seqcount_begin(&pc->lut_seq);
+	for (c = 0; c < LED_BYTES; c++) {
+		/* gamma first, then scale linearly in PWM space */
+		scale = cc->white_balance[c] * cc->brightness;
+		for (v = 0; v < COLOR_LEVELS; v++) {
+			level = DIV_ROUND_CLOSEST(cc->gamma[v] * scale, 255 * 255);
+			sk6812_encode_byte(level, pc->d0, pc->d1, pc->lut[c][v]);
+			/* at most 255 << 8, so the dither error never carries */
+			pc->corr[c][v] = DIV_ROUND_CLOSEST(cc->gamma[v] * scale << 8,
+							   255 * 255);
+		}
+		pc->corr[c][COLOR_LEVELS] = pc->corr[c][COLOR_LEVELS - 1];
+	}
+	for (v = 0; v < COLOR_LEVELS; v++)
+		sk6812_encode_byte(v, pc->d0, pc->d1, pc->lut_out[v]);
+	write_seqcount_end(&pc->lut_seq);
+}
+
+/*
+ * Duty words for the high times of 0 and 1 bits of the strip's protocol
+ * at the current clock rate, as STRIP_POLARITY sends them
+ */
+static void rockchip_pwm_strip_timing(struct rockchip_pwm_chip *pc)
+{
+	pc->d0 = rockchip_pwm_ns_to_ticks(pc, pc->proto->t0h);
+	pc->d1 = rockchip_pwm_ns_to_ticks(pc, pc->proto->t1h);
+
+	rockchip_pwm_lut_build(pc);
+}
+
+/* A wire order is a permutation of R, G, B */
+static bool rockchip_pwm_order_valid(const u8 order[LED_BYTES])
+{
+	unsigned int seen = 0;
+	int c;
+
+	for (c = 0; c < LED_BYTES; c++) {
+		if (order[c] >= LED_BYTES)
+			return false;
+		seen |= BIT(order[c]);
+	}
+
+	return seen == GENMASK(LED_BYTES - 1, 0);
+}
+
+/* Parse a colour order such as "grb", first channel on the wire first */
+static int rockchip_pwm_order_parse(const char *str, u8 order[LED_BYTES])
+{
+	static const char channels[] = "rgb";
+	const char *ch;
+	int c;
+
+	if (strlen(str) != LED_BYTES)
+		return -EINVAL;
+
+	for (c = 0; c < LED_BYTES; c++) {
+		ch = strchr(channels, str[c]);
+		if (!ch)
+			return -EINVAL;
+		order[c] = ch - channels;
+	}
+
+	return rockchip_pwm_order_valid(order) ? 0 : -EINVAL;
+}
+
+/*
+ * Strip geometry from DT: "rockchip,ledstrip-leds" LEDs of
+ * "rockchip,ledstrip-protocol" in "rockchip,ledstrip-color-order", with
+ * buffers for up to "rockchip,ledstrip-max-leds" so userspace can lengthen
+ * the strip later without reallocating.
+ */
+static int rockchip_pwm_strip_config_init(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	const char *proto = "sk6812";
+	const char *order;
+	u32 leds = LEDS_DEFAULT, leds_max = 0;
+	int i;
+
+	device_property_read_u32(dev, "rockchip,ledstrip-leds", &leds);
+	device_property_read_u32(dev, "rockchip,ledstrip-max-leds", &leds_max);
+	leds_max = max(leds_max, leds);
+	if (!leds || leds_max > LEDS_MAX) {
+		dev_err(dev, "Ledstrip of %u (max %u) LEDs, must be 1 to %u\n",
+			leds, leds_max, LEDS_MAX);
+		return -EINVAL;
+	}
+	pc->leds = leds;
+	pc->leds_max = leds_max;
+
+	device_property_read_string(dev, "rockchip,ledstrip-protocol", &proto);
+	pc->proto = &rockchip_pwm_protocols[LEDSTRIP_PROTO_SK6812];
+	for (i = 0; i < ARRAY_SIZE(rockchip_pwm_protocols); i++)
+		if (!strcmp(proto, rockchip_pwm_protocols[i].name))
+			pc->proto = &rockchip_pwm_protocols[i];
+
+	if (strcmp(proto, pc->proto->name))
+		dev_warn(dev, "Unknown ledstrip protocol %s, using %s\n",
+			 proto, pc->proto->name);
+
+	memcpy(pc->wire_order, rockchip_pwm_wire_order, LED_BYTES);
+	if (!device_property_read_string(dev, "rockchip,ledstrip-color-order",
+					 &order) &&
+	    rockchip_pwm_order_parse(order, pc->wire_order)) {
+		dev_warn(dev, "Invalid ledstrip color order %s, using grb\n",
+			 order);
+		memcpy(pc->wire_order, rockchip_pwm_wire_order, LED_BYTES);
+	}
+
+	return 0;
+}
+
+static int rockchip_pwm_lut_init(struct rockchip_pwm_chip *pc)
+{
+	struct ledstrip_correction *cc = &pc->correction;
+	int v;
+
+	pc->lut = devm_kcalloc(pc->chip.dev, LED_BYTES, sizeof(*pc->lut),
+			       GFP_KERNEL);
+	pc->corr = devm_kcalloc(pc->chip.dev, LED_BYTES, sizeof(*pc->corr),
+				GFP_KERNEL);
+	pc->lut_out = devm_kcalloc(pc->chip.dev, COLOR_LEVELS,
+				   sizeof(*pc->lut_out), GFP_KERNEL);
+	if (!pc->lut || !pc->corr || !pc->lut_out)
+		return -ENOMEM;
+
+	/* Identity until userspace loads a correction */
+	for (v = 0; v < COLOR_LEVELS; v++)
+		cc->gamma[v] = v;
+	memset(cc->white_balance, 0xff, sizeof(cc->white_balance));
+	cc->brightness = 0xff;
+
+	mutex_lock(&pc->tx_lock);
+	rockchip_pwm_strip_timing(pc);
+	mutex_unlock(&pc->tx_lock);
+
+	return 0;
+}
+
+static void rockchip_pwm_lut_set(struct rockchip_pwm_chip *pc,
+				 const struct ledstrip_correction *cc)
+{
+	mutex_lock(&pc->tx_lock);
+	pc->correction = *cc;
+	rockchip_pwm_lut_build(pc);
+	mutex_unlock(&pc->tx_lock);
+}
+
+/*
+ * The PWM clock is about to change rate, or just has. PRE_RATE_CHANGE
+ * waits for a frame in flight and marks the change; no frame starts
+ * until POST_RATE_CHANGE or ABORT_RATE_CHANGE clears it, so none goes
+ * out with bit timings for the wrong rate. Nothing is held across the
+ * callbacks: the clock framework skips POST when the rate came out the
+ * same and sends ABORT only to the clock that refused, so either may
+ * never come. Frames wait at most RATE_CHANGE_MS for them.
+ *
+ * On POST the multipliers, the cached ns values of the registers and the
+ * encode table are redone for the new rate; the period and duty registers
+ * are rewritten on the next config, as their last request no longer
+ * matches.
+ */
+static int rockchip_pwm_clk_notify(struct notifier_block *nb,
+				   unsigned long event, void *data)
+{
+	struct rockchip_pwm_chip *pc =
+		container_of(nb, struct rockchip_pwm_chip, clk_nb);
+	struct clk_notifier_data *ndata = data;
+	struct rockchip_pwm_shadow *sh = &pc->shadow;
+
+	switch (event) {
+	case PRE_RATE_CHANGE:
+		mutex_lock(&pc->tx_lock);
+		WRITE_ONCE(pc->rate_changing, true);
+		mutex_unlock(&pc->tx_lock);
+		break;
+	case POST_RATE_CHANGE:
+		mutex_lock(&pc->tx_lock);
+		rockchip_pwm_rate_update(pc, ndata->new_rate);
+		sh->period_ns = rockchip_pwm_ticks_to_ns(pc, sh->period);
+		sh->duty_ns = rockchip_pwm_ticks_to_ns(pc, sh->duty);
+		sh->period_req = U64_MAX;
+		sh->duty_req = U64_MAX;
+		rockchip_pwm_strip_timing(pc);
+		WRITE_ONCE(pc->rate_changing, false);
+		mutex_unlock(&pc->tx_lock);
+		wake_up_all(&pc->rate_wait);
+		break;
+	case ABORT_RATE_CHANGE:
+		WRITE_ONCE(pc->rate_changing, false);
+		wake_up_all(&pc->rate_wait);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+/*
+ * Take tx_lock to send a frame, once no clock rate change is under way.
+ * A change still marked after RATE_CHANGE_MS is one whose POST or ABORT
+ * never came to us, and the rate is the one we have.
+ */
+static void rockchip_pwm_tx_lock(struct rockchip_pwm_chip *pc)
+{
+	for (;;) {
+		if (!wait_event_timeout(pc->rate_wait,
+					!READ_ONCE(pc->rate_changing),
+					msecs_to_jiffies(RATE_CHANGE_MS)))
+			WRITE_ONCE(pc->rate_changing, false);
+
+		mutex_lock(&pc->tx_lock);
+		if (!READ_ONCE(pc->rate_changing))
+			return;
+		mutex_unlock(&pc->tx_lock);
+	}
+}
+
+static void rockchip_pwm_clk_notifier_unregister(void *data)
+{
+	struct rockchip_pwm_chip *pc = data;
+
+	clk_notifier_unregister(pc->clk, &pc->clk_nb);
+}
+
+static int rockchip_pwm_clk_notifier_register(struct rockchip_pwm_chip *pc)
+{
+	int ret;
+
+	init_waitqueue_head(&pc->rate_wait);
+	pc->clk_nb.notifier_call = rockchip_pwm_clk_notify;
+	ret = clk_notifier_register(pc->clk, &pc->clk_nb);
+	if (ret)
+		return ret;
+
+	return devm_add_action_or_reset(pc->chip.dev,
+					rockchip_pwm_clk_notifier_unregister, pc);
+}
+
+/*
+ * Dither a deep frame in output space, see ledstrip-dither.h. Dithering
+ * stays active while any output level has a fraction.
+ */
+static void rockchip_pwm_dither(struct rockchip_pwm_chip *pc,
+				const struct rockchip_pwm_frame *frame)
+{
+	const u16 *const corr[LED_BYTES] = { pc->corr[0], pc->corr[1], pc->corr[2] };
+
+	pc->dither_active = ledstrip_dither(frame->rgb16, pc->leds * LED_BYTES,
+					    corr, pc->dither_err, pc->dither_out);
+	pc->dither_next = ktime_add_ns(ktime_get(),
+				       NSEC_PER_SEC / READ_ONCE(pc->dither_fps));
+}
+
+/* Wire time of @len bits, with generous slack, for completion timeouts */
+static unsigned long rockchip_pwm_tx_timeout(unsigned int len)
+{
+	return msecs_to_jiffies(10 + 4 * DIV_ROUND_UP(len * FPWM, NSEC_PER_MSEC));
+}
+
+/* Load one duty word, taking effect at the next period boundary */
+static __always_inline void
+rockchip_pwm_mmio_put(void __iomem *ctrl_regs, void __iomem *duty_regs,
+		      u32 ctrl, u32 duty)
+{
+	writel_relaxed(ctrl | PWM_LOCK_EN, ctrl_regs); // write ctrl register
+	writel(duty, duty_regs); // write duty cycle value
+	writel(ctrl, ctrl_regs); // write new lock enable value in ctrl register
+}
+
+/* Spin until the counter wraps into the next period, false if it has stopped */
+static __always_inline bool
+rockchip_pwm_mmio_wrap(void __iomem *cntr_regs, u32 *prev)
+{
+	unsigned int spins;
+	u32 cnt;
+
+	for (spins = 0; spins < PACE_SPINS; spins++) {
+		cnt = readl_relaxed(cntr_regs);
+		if (cnt < *prev) {
+			*prev = cnt;
+			return true;
+		}
+		*prev = cnt;
+	}
+
+	return false;
+}
+
+/*
+ * The last bit is out, or will be in @idle_ns, after which the line stays
+ * low: note when the strip latches the frame, RST of low line later, then
+ * hold the line low until it has.
+ */
+static void rockchip_pwm_tx_latch(struct rockchip_pwm_chip *pc, u64 idle_ns)
+{
+	pc->tx_latched = ktime_add_ns(ktime_get(), idle_ns + RST);
+	usleep_range(LATCH_US, LATCH_US + 1000);
+}
+
+/*
+ * Bit-bang MMIO: the CPU writes every duty word itself with interrupts
+ * off. The period register lock makes a word take effect at the next
+ * period boundary, and after each write we spin on the counter until it
+ * wraps, so exactly one word goes out per period, as in
+ * direct_pwm_access_rk3568.c.
+ *
+ * Interrupts are only held off for chunk_leds LEDs at a time. Between
+ * chunks the line is parked low, which the strip sees as a stretched low
+ * period as long as the pause stays well short of RST; a chunk that
+ * starts more than CHUNK_GAP_NS after the park is a stall.
+ *
+ * Inside a chunk the channel keeps running, so an NMI, a firmware call or
+ * a stalled bus that holds us past a period boundary repeats the last
+ * word: an extra bit, and a corrupt frame from there on. Every LED
+ * boundary is timestamped, and one more than half a bit period later
+ * than the LED's wire time means a boundary went by unwritten. On a
+ * stall the line is parked, and the frame is sent again from the first
+ * LED once the strip has latched.
+ */
+static __always_inline int
+__rockchip_pwm_tx_mmio(struct rockchip_pwm_chip *pc, const u32 *duty,
+		       unsigned int len, const struct rockchip_pwm_data *data)
+{
+	unsigned int chunk = READ_ONCE(pc->chunk_leds) * LED_BITS;
+	u64 led_ns = (u64)LED_BITS * pc->proto->period;
+	void __iomem *ctrl_regs, *duty_regs, *cntr_regs;
+	unsigned int k, b, end, led_end, tries = 0;
+	unsigned long flags;
+	u64 now, mark = 0, due = 0, slack = 0;
+	s64 late;
+	u32 ctrl, prev;
+
+	ctrl_regs = pc->base + data->regs.ctrl;
+	duty_regs = pc->base + data->regs.duty;
+	cntr_regs = pc->base + data->regs.cntr;
+	ctrl = pc->shadow.ctrl & ~PWM_LOCK_EN; // shadowed control register
+
+restart:
+	for (k = 0; k < len; k = end)
+	{
+		end = min(k + chunk, len);
+
+		local_irq_save(flags);
+		prev = readl_relaxed(cntr_regs);
+
+		for (; k < end; k = led_end) {
+			/* NMI-safe and cheap enough for every LED */
+			now = ktime_get_mono_fast_ns();
+			late = now - mark - due;
+			if (k && late > (s64)slack) {
+				rockchip_pwm_mmio_put(ctrl_regs, duty_regs,
+						      ctrl, DUTY_IDLE);
+				local_irq_restore(flags);
+				goto stall;
+			}
+			mark = now;
+			due = led_ns;
+			slack = pc->proto->period / 2;
+
+			led_end = min(k + LED_BITS, end);
+			for (b = k; b < led_end; b++) {
+				rockchip_pwm_mmio_put(ctrl_regs, duty_regs,
+						      ctrl, duty[b]);
+				if (!rockchip_pwm_mmio_wrap(cntr_regs, &prev)) {
+					rockchip_pwm_mmio_put(ctrl_regs, duty_regs,
+							      ctrl, DUTY_IDLE);
+					local_irq_restore(flags);
+					goto stopped;
+				}
+			}
+		}
+
+		rockchip_pwm_mmio_put(ctrl_regs, duty_regs, ctrl, DUTY_IDLE);
+		mark = ktime_get_mono_fast_ns();
+		due = 0;
+		slack = CHUNK_GAP_NS;
+
+		local_irq_restore(flags);
+	}
+	pc->shadow.ctrl = ctrl;
+	rockchip_pwm_shadow_duty(pc, DUTY_IDLE);
+
+	/* the idle word takes over once the last bit's period is done */
+	rockchip_pwm_tx_latch(pc, pc->proto->period);
+
+	return 0;
+
+stall:
+	pc->shadow.ctrl = ctrl;
+	rockchip_pwm_shadow_duty(pc, DUTY_IDLE);
+	WRITE_ONCE(pc->stat_stalls, pc->stat_stalls + 1);
+	dev_warn_ratelimited(pc->chip.dev,
+			     "transmit stalled %lld ns at LED %u, resending frame\n",
+			     late, k / LED_BITS);
+	usleep_range(LATCH_US, LATCH_US + 1000);
+	if (++tries <= CHUNK_RETRIES)
+		goto restart;
+
+	return -ETIMEDOUT;
+
+stopped:
+	pc->shadow.ctrl = ctrl;
+	rockchip_pwm_shadow_duty(pc, DUTY_IDLE);
+	dev_err_ratelimited(pc->chip.dev, "PWM counter stopped at LED %u\n",
+			    k / LED_BITS);
+
+	return -EIO;
+}
+
+static int rockchip_pwm_tx_mmio(struct rockchip_pwm_chip *pc,
+				const u32 *duty, unsigned int len)
+{
+	return pc->hw->tx_mmio(pc, duty, len);
+}
+
+static const struct rockchip_pwm_tx_backend rockchip_pwm_tx_mmio_backend = {
+	.name = "mmio",
+	.transmit = rockchip_pwm_tx_mmio,
+};
+
+static int rockchip_pwm_tx_irq_init(struct rockchip_pwm_chip *pc)
+{
+	/* needs the oneshot interrupt and the v2/v3 enable/continuous bits */
+	if (pc->irq <= 0 || pc->data->vop_pwm ||
+	    !(pc->data->enable_conf & PWM_CONTINUOUS))
+		return -ENODEV;
+
+	return 0;
+}
+
+static int rockchip_pwm_tx_irq(struct rockchip_pwm_chip *pc,
+			       const u32 *duty, unsigned int len)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	reinit_completion(&pc->tx_done);
+	pc->paced.len = len;
+	pc->paced.pos = 0;
+	pc->paced.ctrl = pc->shadow.ctrl;
+	pc->paced.done = false;
+
+	rockchip_pwm_int_enable(pc, true);
+
+	local_irq_save(flags);
+	WRITE_ONCE(pc->paced.duty, duty);
+	rockchip_pwm_paced_prepare(pc);
+	pc->hw->paced_next(pc);
+	local_irq_restore(flags);
+
+	if (!wait_for_completion_timeout(&pc->tx_done,
+					 rockchip_pwm_tx_timeout(len)))
+		ret = -ETIMEDOUT;
+
+	/*
+	 * After a timeout the hard half may still be arming a burst on
+	 * another CPU, so it is stopped and waited for before the frame is
+	 * taken away; a late completion must not leak into the next frame.
+	 */
+	rockchip_pwm_int_enable(pc, false);
+	if (ret) {
+		synchronize_irq(pc->irq);
+		WRITE_ONCE(pc->paced.duty, NULL);
+		WRITE_ONCE(pc->paced.done, false);
+	}
+	/*
+	 * The last burst is over. Back to continuous output, but at the idle
+	 * duty: the last bit's duty would keep toggling the line and the
+	 * strip would never latch.
+	 */
+	writel_relaxed(DUTY_IDLE, pc->base + pc->data->regs.duty);
+	writel(pc->paced.ctrl, pc->base + pc->data->regs.ctrl);
+	rockchip_pwm_shadow_duty(pc, DUTY_IDLE);
+
+	rockchip_pwm_tx_latch(pc, 0);
+
+	return ret;
+}
+
+static const struct rockchip_pwm_tx_backend rockchip_pwm_tx_irq_backend = {
+	.name = "irq",
+	.init = rockchip_pwm_tx_irq_init,
+	.transmit = rockchip_pwm_tx_irq,
+};
+
+static void rockchip_pwm_tx_dma_done(void *data)
+{
+	struct rockchip_pwm_chip *pc = data;
+
+	complete(&pc->tx_done);
+}
+
+static int rockchip_pwm_tx_dma_init(struct rockchip_pwm_chip *pc)
+{
+	struct dma_slave_config cfg = { };
+	struct device *dma_dev;
+	int ret;
+
+	pc->dma_chan = dma_request_chan(pc->chip.dev, "tx");
+	if (IS_ERR(pc->dma_chan))
+		return PTR_ERR(pc->dma_chan);
+
+	/* one duty word per DMA request from the PWM */
+	cfg.direction = DMA_MEM_TO_DEV;
+	cfg.dst_addr = pc->phys_base + pc->data->regs.duty;
+	cfg.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+	cfg.dst_maxburst = 1;
+	ret = dmaengine_slave_config(pc->dma_chan, &cfg);
+	if (ret)
+		goto err_release;
+
+	/* one extra word, the idle duty that ends every frame */
+	dma_dev = pc->dma_chan->device->dev;
+	pc->tx_buf = dma_alloc_coherent(dma_dev,
+					(pc->leds_max * LED_BITS + 1) * sizeof(u32),
+					&pc->tx_dma, GFP_KERNEL);
+	if (!pc->tx_buf) {
+		ret = -ENOMEM;
+		goto err_release;
+	}
+
+	return 0;
+
+err_release:
+	dma_release_channel(pc->dma_chan);
+	return ret;
+}
+
+static void rockchip_pwm_tx_dma_exit(struct rockchip_pwm_chip *pc)
+{
+	dmaengine_terminate_sync(pc->dma_chan);
+	dma_free_coherent(pc->dma_chan->device->dev,
+			  (pc->leds_max * LED_BITS + 1) * sizeof(u32), pc->tx_buf,
+			  pc->tx_dma);
+	dma_release_channel(pc->dma_chan);
+}
+
+static int rockchip_pwm_tx_dma(struct rockchip_pwm_chip *pc,
+			       const u32 *duty, unsigned int len)
+{
+	struct dma_async_tx_descriptor *desc;
+	dma_cookie_t cookie;
+
+	/* frames that keep their own duty words still need to reach the DMA buffer */
+	if (duty != pc->tx_buf)
+		memcpy(pc->tx_buf, duty, len * sizeof(u32));
+	/* the PWM keeps repeating the last word, make it the idle duty */
+	pc->tx_buf[len] = DUTY_IDLE;
+
+	desc = dmaengine_prep_slave_single(pc->dma_chan, pc->tx_dma,
+					   (len + 1) * sizeof(u32), DMA_MEM_TO_DEV,
+					   DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc)
+		return -EIO;
+
+	desc->callback = rockchip_pwm_tx_dma_done;
+	desc->callback_param = pc;
+	reinit_completion(&pc->tx_done);
+
+	cookie = dmaengine_submit(desc);
+	if (dma_submit_error(cookie))
+		return -EIO;
+	dma_async_issue_pending(pc->dma_chan);
+
+	if (!wait_for_completion_timeout(&pc->tx_done,
+					 rockchip_pwm_tx_timeout(len))) {
+		dmaengine_terminate_sync(pc->dma_chan);
+		/* the duty register holds whatever word was last delivered */
+		rockchip_pwm_shadow_duty(pc, readl_relaxed(pc->base +
+							   pc->data->regs.duty));
+		return -ETIMEDOUT;
+	}
+	rockchip_pwm_shadow_duty(pc, DUTY_IDLE);
+
+	/* the idle word was requested as the last bit's period began */
+	rockchip_pwm_tx_latch(pc, pc->proto->period);
+
+	return 0;
+}
+
+static const struct rockchip_pwm_tx_backend rockchip_pwm_tx_dma_backend = {
+	.name = "dma",
+	.init = rockchip_pwm_tx_dma_init,
+	.exit = rockchip_pwm_tx_dma_exit,
+	.transmit = rockchip_pwm_tx_dma,
+};
+
+/*
+ * Simulated DMA: the duty words land in a capture buffer instead of the
+ * duty register, and completion arrives from a timer after the frame's
+ * wire time, as a DMA callback would. The last frame is readable from
+ * debugfs, so the whole pipeline can be checked without a strip.
+ */
+static enum hrtimer_restart rockchip_pwm_tx_sim_done(struct hrtimer *timer)
+{
+	struct rockchip_pwm_chip *pc =
+		container_of(timer, struct rockchip_pwm_chip, sim_timer);
+
+	complete(&pc->tx_done);
+
+	return HRTIMER_NORESTART;
+}
+
+static int rockchip_pwm_tx_sim_init(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+
+	pc->sim_capture.data = rockchip_pwm_kvcalloc(dev, pc->leds_max * LED_BITS,
+						     sizeof(u32));
+	if (!pc->sim_capture.data)
+		return -ENOMEM;
+
+	hrtimer_init(&pc->sim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pc->sim_timer.function = rockchip_pwm_tx_sim_done;
+
+	pc->debugfs = debugfs_create_dir(dev_name(dev), NULL);
+	debugfs_create_blob("capture", 0400, pc->debugfs, &pc->sim_capture);
+
+	return 0;
+}
+
+static void rockchip_pwm_tx_sim_exit(struct rockchip_pwm_chip *pc)
+{
+	hrtimer_cancel(&pc->sim_timer);
+	debugfs_remove_recursive(pc->debugfs);
+}
+
+static int rockchip_pwm_tx_sim(struct rockchip_pwm_chip *pc,
+			       const u32 *duty, unsigned int len)
+{
+	reinit_completion(&pc->tx_done);
+	memcpy(pc->sim_capture.data, duty, len * sizeof(u32));
+	pc->sim_capture.size = len * sizeof(u32);
+	hrtimer_start(&pc->sim_timer, ns_to_ktime((u64)len * pc->proto->period),
+		      HRTIMER_MODE_REL);
+
+	if (!wait_for_completion_timeout(&pc->tx_done,
+					 rockchip_pwm_tx_timeout(len))) {
+		hrtimer_cancel(&pc->sim_timer);
+		return -ETIMEDOUT;
+	}
+
+	rockchip_pwm_tx_latch(pc, 0);
+
+	return 0;
+}
+
+static const struct rockchip_pwm_tx_backend rockchip_pwm_tx_sim_backend = {
+	.name = "dma-sim",
+	.init = rockchip_pwm_tx_sim_init,
+	.exit = rockchip_pwm_tx_sim_exit,
+	.transmit = rockchip_pwm_tx_sim,
+};
+
+/*
+ * SPI client side of the strip: a "rockchip,ledstrip-spi" device on an
+ * SPI controller, which this driver binds so no other driver shares it.
+ * The PWM device that names it in "rockchip,ledstrip-spi" sends through it.
+ */
+static int rockchip_pwm_spi_probe(struct spi_device *spi)
+{
+	/* MOSI idles low between frames */
+	spi->mode = SPI_MODE_0;
+	spi->bits_per_word = 8;
+
+	return spi_setup(spi);
+}
+
+static const struct of_device_id rockchip_pwm_spi_dt_ids[] = {
+	{ .compatible = "rockchip,ledstrip-spi" },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, rockchip_pwm_spi_dt_ids);
+
+static struct spi_driver rockchip_pwm_spi_driver = {
+	.driver = {
+		.name = "rockchip-pwm-ledstrip-spi",
+		.of_match_table = rockchip_pwm_spi_dt_ids,
+	},
+	.probe = rockchip_pwm_spi_probe,
+};
+
+/*
+ * SPI waveform: every LED bit becomes a fixed SPI bit pattern (see
+ * sk6812.h) and the whole frame, reset gaps included, goes out as one
+ * SPI transfer to the SPI client named by "rockchip,ledstrip-spi".
+ * The duty words already carry the corrected bits, so this shares the
+ * whole pixel pipeline with the PWM backends.
+ */
+static int rockchip_pwm_tx_spi_init(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	struct device *spi_dev;
+	struct device_node *np;
+	u32 bits = 4;
+
+	np = of_parse_phandle(dev->of_node, "rockchip,ledstrip-spi", 0);
+	if (!np)
+		return -ENODEV;
+
+	spi_dev = bus_find_device_by_of_node(&spi_bus_type, np);
+	of_node_put(np);
+	if (!spi_dev)
+		return -EPROBE_DEFER;
+
+	/* only once our SPI client has it; the link unbinds us before it */
+	if (spi_dev->driver != &rockchip_pwm_spi_driver.driver ||
+	    !device_link_add(dev, spi_dev, DL_FLAG_AUTOREMOVE_CONSUMER)) {
+		put_device(spi_dev);
+		return -EPROBE_DEFER;
+	}
+	pc->spi = to_spi_device(spi_dev);
+
+	device_property_read_u32(dev, "rockchip,ledstrip-spi-bits", &bits);
+	pc->spi_format = bits == 3 ? &sk6812_spi_3bit : &sk6812_spi_4bit;
+
+	/* capacity for leds_max; kmalloc, as SPI controllers DMA from it */
+	pc->spi_len = 2 * sk6812_spi_reset_bytes(pc->spi_format) +
+		      sk6812_spi_frame_bytes(pc->spi_format,
+					     pc->leds_max * LED_BYTES);
+	pc->spi_buf = devm_kzalloc(dev, pc->spi_len, GFP_KERNEL);
+	if (!pc->spi_buf) {
+		put_device(&pc->spi->dev);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void rockchip_pwm_tx_spi_exit(struct rockchip_pwm_chip *pc)
+{
+	put_device(&pc->spi->dev);
+}
+
+static int rockchip_pwm_tx_spi(struct rockchip_pwm_chip *pc,
+			       const u32 *duty, unsigned int len)
+{
+	size_t reset = sk6812_spi_reset_bytes(pc->spi_format);
+	struct spi_transfer xfer = {
+		.tx_buf = pc->spi_buf,
+		.speed_hz = pc->spi_format->hz,
+		.bits_per_word = 8,
+	};
+	struct sk6812_spi_writer w;
+	size_t bytes;
+	unsigned int i;
+	int ret;
+
+	/* the leading reset bytes stay zero, the trailing ones move with len */
+	sk6812_spi_begin(&w, pc->spi_format, pc->spi_buf + reset);
+	for (i = 0; i < len; i++)
+		sk6812_spi_put(&w, duty[i] == pc->d1);
+	bytes = sk6812_spi_end(&w);
+	memset(pc->spi_buf + reset + bytes, 0, reset);
+	xfer.len = 2 * reset + bytes;
+
+	/* the trailing reset bytes are the latch, it is done on return */
+	ret = spi_sync_transfer(pc->spi, &xfer, 1);
+	pc->tx_latched = ktime_get();
+
+	return ret;
+}
+
+static const struct rockchip_pwm_tx_backend rockchip_pwm_tx_spi_backend = {
+	.name = "spi",
+	.no_pwm = true,
+	.init = rockchip_pwm_tx_spi_init,
+	.exit = rockchip_pwm_tx_spi_exit,
+	.transmit = rockchip_pwm_tx_spi,
+};
+
+static const struct rockchip_pwm_tx_backend *rockchip_pwm_tx_backends[] = {
+	&rockchip_pwm_tx_mmio_backend,
+	&rockchip_pwm_tx_irq_backend,
+	&rockchip_pwm_tx_dma_backend,
+	&rockchip_pwm_tx_sim_backend,
+	&rockchip_pwm_tx_spi_backend,
+};
+
+/*
+ * Pick the backend named by "rockchip,ledstrip-backend", falling back to
+ * bit-bang MMIO when it is unknown or its resources are missing.
+ */
+static int rockchip_pwm_tx_init(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	const char *name = "mmio";
+	int i, ret;
+
+	init_completion(&pc->tx_done);
+	pc->chunk_leds = CHUNK_LEDS_DEFAULT;
+	device_property_read_string(dev, "rockchip,ledstrip-backend", &name);
+
+	pc->tx = &rockchip_pwm_tx_mmio_backend;
+	for (i = 0; i < ARRAY_SIZE(rockchip_pwm_tx_backends); i++)
+		if (!strcmp(name, rockchip_pwm_tx_backends[i]->name))
+			pc->tx = rockchip_pwm_tx_backends[i];
+
+	if (strcmp(name, pc->tx->name))
+		dev_warn(dev, "Unknown ledstrip backend %s, using mmio\n", name);
+
+	if (pc->tx->init) {
+		ret = pc->tx->init(pc);
+		if (ret == -EPROBE_DEFER)
+			return ret;
+		if (ret) {
+			dev_warn(dev, "Ledstrip backend %s unavailable (%d), using mmio\n",
+				 pc->tx->name, ret);
+			pc->tx = &rockchip_pwm_tx_mmio_backend;
+		}
+	}
+
+	if (!pc->tx_buf) {
+		pc->tx_buf = rockchip_pwm_kvcalloc(dev, pc->leds_max * LED_BITS,
+						   sizeof(u32));
+		if (!pc->tx_buf) {
+			if (pc->tx->exit)
+				pc->tx->exit(pc);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void rockchip_pwm_tx_exit(struct rockchip_pwm_chip *pc)
+{
+	if (pc->tx->exit)
+		pc->tx->exit(pc);
+}
+
+/*
+ * Duty words of the most recent frame, called with tx_lock held. 8-bit
+ * frames keep their own duty words, encoded by their producer, and are
+ * only encoded here again after an encode table change; deep frames are
+ * dithered and encoded into pc->tx_buf on every refresh.
+ */
+static const u32 *rockchip_pwm_strip_encode(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_frame *frame;
+	ktime_t start = ktime_get();
+	const u32 *duty;
+
+	pc->tx_seq = 0;
+	pc->tx_target = 0;
+	pc->tx_held = false;
+	duty = rockchip_pwm_slot_encode(pc);
+	if (duty)
+		goto out;
+
+	duty = pc->tx_buf;
+	frame = rockchip_pwm_frame_acquire(pc);
+	pc->tx_seq = frame->seq;
+	pc->tx_target = frame->target_ns;
+	pc->dither_active = false;
+	if (frame->deep) {
+		rockchip_pwm_dither(pc, frame);
+		rockchip_pwm_encode_chunked(pc, pc->dither_out, pc->tx_buf, true);
+	} else {
+		rockchip_pwm_frame_encode(pc, frame);
+		duty = frame->duty;
+	}
+
+out:
+	WRITE_ONCE(pc->stat_encode_ns, ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	return duty;
+}
+
+/*
+ * Start of a frame to its latch, as the bit periods alone would take
+ * plus what the backend added last time (chunk gaps, DMA and SPI setup).
+ */
+static u64 rockchip_pwm_present_lead(struct rockchip_pwm_chip *pc)
+{
+	return (u64)pc->leds * LED_BITS * pc->proto->period + RST +
+	       READ_ONCE(pc->tx_overhead_ns);
+}
+
+/*
+ * Transmitter side, before tx_lock: if the frame about to be taken, or
+ * the one held back last time, has a target, sleep until shortly before
+ * it has to start. Returns true when woken early by a newer frame, which
+ * is then looked at instead.
+ */
+static bool rockchip_pwm_present_wait(struct rockchip_pwm_chip *pc)
+{
+	unsigned long flags;
+	u64 target = 0, seq;
+	int latest;
+	s64 wait;
+
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	latest = ledstrip_tribuf_peek(&pc->frame_idx);
+	if (latest >= 0)
+		target = pc->frames[latest].target_ns;
+	else if (pc->tx_held)
+		target = pc->tx_target;
+	seq = pc->frame_seq;
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+
+	if (!target || atomic_read(&pc->slot_show))
+		return false;
+
+	wait = target - rockchip_pwm_present_lead(pc) - PRESENT_WAKE_NS -
+	       ktime_get_ns();
+	if (wait <= 0)
+		return false;
+
+	return wait_event_interruptible_hrtimeout(pc->tx_wait,
+			kthread_should_stop() || READ_ONCE(pc->frame_seq) != seq,
+			ns_to_ktime(wait)) != -ETIME;
+}
+
+/* When a timed frame has to start, or 0 if it is untimed or a repeat */
+static ktime_t rockchip_pwm_present_start(struct rockchip_pwm_chip *pc)
+{
+	if (!pc->tx_target || pc->tx_seq == pc->status.sent)
+		return 0;
+
+	return ns_to_ktime(pc->tx_target - rockchip_pwm_present_lead(pc));
+}
+
+/*
+ * With tx_lock held and the frame encoded, before the backend is set up:
+ * the frame taken may be newer than the one present_wait() looked at. If
+ * it has to start more than PRESENT_WAKE_NS from now, it is held back,
+ * for the transmit thread to wait for it without tx_lock.
+ */
+static bool rockchip_pwm_present_hold(struct rockchip_pwm_chip *pc)
+{
+	ktime_t start = rockchip_pwm_present_start(pc);
+
+	pc->tx_held = start &&
+		      ktime_sub(start, ktime_get()) > PRESENT_WAKE_NS;
+	/* taken by rockchip_pwm_apply(), the thread has to know */
+	if (pc->tx_held)
+		wake_up(&pc->tx_wait);
+
+	return pc->tx_held;
+}
+
+/*
+ * Start the frame so that it latches at its target. Sleep to just short
+ * of the start, at most PRESENT_WAKE_NS after present_hold(), then spin
+ * the rest; a target already too close goes out at once.
+ */
+static void rockchip_pwm_present_sync(struct rockchip_pwm_chip *pc)
+{
+	ktime_t start, wake;
+
+	start = rockchip_pwm_present_start(pc);
+	if (!start)
+		return;
+
+	wake = ktime_sub_ns(start, PRESENT_SPIN_NS);
+	if (ktime_before(ktime_get(), wake)) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout_range(&wake, 0, HRTIMER_MODE_ABS);
+	}
+	while (ktime_before(ktime_get(), start))
+		cpu_relax();
+}
+
+/*
+ * A frame started at @start finished going out at @end. Only its first
+ * refresh counts as sent, repeats for dithering or after a resume don't
+ * move the stamps.
+ */
+static void rockchip_pwm_status_sent(struct rockchip_pwm_chip *pc,
+				     ktime_t start, ktime_t end)
+{
+	const struct rockchip_pwm_frame *frame = &pc->frames[pc->frame_idx.front];
+	unsigned long flags;
+	s64 over;
+
+	/* learn the backend's overhead for the next timed start */
+	over = ktime_to_ns(ktime_sub(pc->tx_latched, start)) -
+	       (s64)((u64)pc->leds * LED_BITS * pc->proto->period + RST);
+	WRITE_ONCE(pc->tx_overhead_ns, max_t(s64, over, 0));
+
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	pc->status.refreshes++;
+	if (pc->tx_seq && pc->tx_seq != pc->status.sent) {
+		pc->status.sent = pc->tx_seq;
+		pc->status.published_ns = frame->published_ns;
+		pc->status.sent_ns = ktime_to_ns(end);
+		pc->status.target_ns = pc->tx_target;
+		pc->status.present_ns = ktime_to_ns(pc->tx_latched);
+	}
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+}
+
+/*
+ * Send the most recent complete frame down the strip. Called with tx_lock
+ * held, either from rockchip_pwm_apply() or from the transmit thread once
+ * a producer has published a frame.
+ */
+static int rockchip_pwm_strip_transmit(struct rockchip_pwm_chip *pc,
+				       struct pwm_device *pwm)
+{
+	struct pwm_chip *chip = &pc->chip;
+	struct pwm_state curstate;
+	struct pwm_state strip_state = { };
+	const u32 *duty;
+
+	ktime_t start_time, end_time;
+	ktime_t setup_start, setup_end, stop_start;
+
+	bool enabled;
+
+	int ret, err;
+
+	duty = rockchip_pwm_strip_encode(pc);
+	if (rockchip_pwm_present_hold(pc))
+		return 0;
+
+	if (pc->tx->no_pwm) {
+		rockchip_pwm_present_sync(pc);
+		start_time = ktime_get();
+		ret = pc->tx->transmit(pc, duty, pc->leds * LED_BITS);
+		end_time = ktime_get();
+		WRITE_ONCE(pc->stat_tx_ns,
+			   ktime_to_ns(ktime_sub(end_time, start_time)));
+		if (!ret)
+			rockchip_pwm_status_sent(pc, start_time, end_time);
+		return ret;
+	}
+
+	setup_start = ktime_get();
+	setup_end = stop_start = setup_start;
+
+	/* PWM peripheral & APB clocks stay up until AUTOSUSPEND_MS of idle */
+	ret = pm_runtime_resume_and_get(chip->dev);
+	if (ret) {
+		dev_err(chip->dev, "failed to resume: %d\n", ret);
+		return ret;
+	}
+
+	strip_state.enabled = true;
+	strip_state.period = pc->proto->period;
+	strip_state.duty_cycle = 0;
+	strip_state.polarity = STRIP_POLARITY;
+
+	pwm_get_state(pwm, &curstate);
+	enabled = curstate.enabled;
+
+	pc->hw->config(chip, pwm, &strip_state);
+	if (strip_state.enabled != enabled) {
+		ret = pc->hw->enable(chip, pwm, strip_state.enabled);
+		if (ret)
+			goto out;
+	}
+
+	if (strip_state.enabled)
+		ret = pinctrl_select_state(pc->pinctrl, pc->active_state);
+
+	setup_end = ktime_get();
+	rockchip_pwm_present_sync(pc);
+
+	start_time = ktime_get();
+	ret = pc->tx->transmit(pc, duty, pc->leds * LED_BITS);
+	end_time = ktime_get();
+	WRITE_ONCE(pc->stat_tx_ns, ktime_to_ns(ktime_sub(end_time, start_time)));
+	if (ret)
+		dev_warn_ratelimited(chip->dev, "%s transmit failed: %d\n",
+				     pc->tx->name, ret);
+	else
+		rockchip_pwm_status_sent(pc, start_time, end_time);
+
+	stop_start = ktime_get();
+	strip_state.enabled = false;
+	pwm_get_state(pwm, &curstate);
+	enabled = curstate.enabled;
+	
+	pc->hw->config(chip, pwm, &strip_state);
+	if (strip_state.enabled != enabled) 
+	{
+		err = pc->hw->enable(chip, pwm, strip_state.enabled);
+		if (err)
+			ret = err;
+	}
+
+	dev_dbg(chip->dev, "frame sent in %lld ns\n",
+		ktime_to_ns(ktime_sub(end_time, start_time)));
+
+out:
+	pm_runtime_mark_last_busy(chip->dev);
+	pm_runtime_put_autosuspend(chip->dev);
+
+	WRITE_ONCE(pc->stat_setup_ns,
+		   ktime_to_ns(ktime_sub(setup_end, setup_start)) +
+		   ktime_to_ns(ktime_sub(ktime_get(), stop_start)));
+
+	return ret;
+}
+
+/*
+ * Publish a complete frame of @len bytes, 8 or 16 bits per channel, to
+ * latch at CLOCK_MONOTONIC @target_ns, or as soon as it can for 0. The
+ * length is checked against the strip under frame_lock, a frame sized for
+ * a strip length that has since changed is refused.
+ */
+static int rockchip_pwm_frame_submit(struct rockchip_pwm_chip *pc,
+				     const u8 *pixels, size_t len,
+				     u64 target_ns)
+{
+	struct rockchip_pwm_frame *frame;
+	unsigned long flags;
+	size_t bytes;
+
+	frame = rockchip_pwm_frame_begin(pc, &flags);
+	bytes = pc->leds * LED_BYTES;
+	if (len != bytes && len != bytes * 2) {
+		rockchip_pwm_frame_cancel(pc, flags);
+		return -EINVAL;
+	}
+
+	frame->target_ns = target_ns;
+	frame->deep = len == bytes * 2;
+	if (frame->deep) {
+		memcpy(frame->rgb16, pixels, len);
+	} else {
+		memcpy(pc->stage, pixels, len);
+		rockchip_pwm_stage_mark(pc, 0, pc->leds);
+	}
+	rockchip_pwm_frame_publish(pc, flags);
+
+	return 0;
+}
+
+static void rockchip_pwm_queue_init(struct rockchip_pwm_chip *pc)
+{
+	INIT_KFIFO(pc->queue);
+	spin_lock_init(&pc->queue_lock);
+	init_waitqueue_head(&pc->queue_wait);
+	pc->queue_policy = QUEUE_LATEST;
+}
+
+/*
+ * Producer side: queue @qf, applying the policy when the queue is full.
+ * The queue owns @qf once this returns 0, on error the caller frees it.
+ * Returns 1 under QUEUE_LATEST, for the caller to submit @qf directly.
+ * A writer blocked under QUEUE_BLOCK is woken by a policy change too and
+ * goes by the new policy.
+ */
+static int rockchip_pwm_queue_push(struct rockchip_pwm_chip *pc,
+				   struct rockchip_pwm_qframe *qf,
+				   bool nonblock)
+{
+	struct rockchip_pwm_qframe *old = NULL;
+	int ret;
+
+	spin_lock(&pc->queue_lock);
+	for (;;) {
+		if (pc->queue_policy == QUEUE_LATEST) {
+			spin_unlock(&pc->queue_lock);
+			return 1;
+		}
+		if (!kfifo_is_full(&pc->queue))
+			break;
+		if (pc->queue_policy == QUEUE_DROP_OLDEST) {
+			kfifo_get(&pc->queue, &old);
+			pc->queue_drops++;
+			break;
+		}
+		if (pc->queue_policy == QUEUE_DROP_NEWEST) {
+			pc->queue_drops++;
+			spin_unlock(&pc->queue_lock);
+			kfree(qf);
+			return 0;
+		}
+		spin_unlock(&pc->queue_lock);
+
+		if (nonblock)
+			return -EAGAIN;
+		ret = wait_event_interruptible(pc->queue_wait,
+					       !kfifo_is_full(&pc->queue) ||
+					       READ_ONCE(pc->queue_policy) != QUEUE_BLOCK ||
+					       READ_ONCE(pc->gone));
+		if (ret)
+			return ret;
+		if (READ_ONCE(pc->gone))
+			return -ENODEV;
+
+		spin_lock(&pc->queue_lock);
+	}
+	kfifo_put(&pc->queue, qf);
+	spin_unlock(&pc->queue_lock);
+
+	kfree(old);
+	wake_up(&pc->tx_wait);
+
+	return 0;
+}
+
+/*
+ * Transmitter side: hand the oldest queued frame, if any, to the strip.
+ * Returns false when the queue was empty.
+ */
+static bool rockchip_pwm_queue_pop(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_qframe *qf;
+	unsigned int n;
+
+	spin_lock(&pc->queue_lock);
+	n = kfifo_get(&pc->queue, &qf);
+	spin_unlock(&pc->queue_lock);
+	if (!n)
+		return false;
+
+	wake_up_interruptible(&pc->queue_wait);
+	rockchip_pwm_frame_submit(pc, qf->pixels, qf->len, qf->target_ns);
+	kfree(qf);
+
+	return true;
+}
+
+/* Discard every queued frame, on reconfiguration and removal */
+static void rockchip_pwm_queue_flush(struct rockchip_pwm_chip *pc)
+{
+	struct rockchip_pwm_qframe *qf;
+
+	spin_lock(&pc->queue_lock);
+	while (kfifo_get(&pc->queue, &qf))
+		kfree(qf);
+	spin_unlock(&pc->queue_lock);
+
+	wake_up_interruptible(&pc->queue_wait);
+}
+
+/* Something new for the strip, dither refreshes aside */
+static inline bool rockchip_pwm_tx_work(struct rockchip_pwm_chip *pc)
+{
+	int show = atomic_read(&pc->slot_show);
+
+	if (READ_ONCE(pc->tx_suspended))
+		return false;
+
+	/* an effect frame to render, even if it then waits for the slot */
+	if (atomic_read(&pc->fx_due))
+		return true;
+
+	/* a timed frame taken too early, present_wait() sleeps for it */
+	if (READ_ONCE(pc->tx_held) && !show)
+		return true;
+
+	/* submitted frames wait while a slot is shown, the queue is drained */
+	if (show)
+		return show & SLOT_FRESH || READ_ONCE(pc->tx_resend) ||
+		       !kfifo_is_empty(&pc->queue);
+
+	return READ_ONCE(pc->tx_resend) || !kfifo_is_empty(&pc->queue) ||
+	       ledstrip_tribuf_fresh(&pc->frame_idx);
+}
+
+static inline bool rockchip_pwm_tx_pending(struct rockchip_pwm_chip *pc)
+{
+	if (rockchip_pwm_tx_work(pc))
+		return true;
+
+	/* Dithering only converges over successive refreshes, keep going */
+	return !READ_ONCE(pc->tx_suspended) && !atomic_read(&pc->slot_show) &&
+	       READ_ONCE(pc->dither_active);
+}
+
+/*
+ * A dither refresh with nothing new to send waits for its slot at
+ * dither_fps. Returns true when woken early by new work, which is then
+ * looked at instead.
+ */
+static bool rockchip_pwm_dither_wait(struct rockchip_pwm_chip *pc)
+{
+	ktime_t wait;
+
+	if (rockchip_pwm_tx_work(pc))
+		return false;
+
+	wait = ktime_sub(READ_ONCE(pc->dither_next), ktime_get());
+	if (wait <= 0)
+		return false;
+
+	return !wait_event_interruptible_hrtimeout(pc->tx_wait,
+						   kthread_should_stop() ||
+						   rockchip_pwm_tx_work(pc),
+						   wait);
+}
+
+/*
+ * Per-strip transmit thread, woken by producers. It runs SCHED_FIFO and
+ * can be bound to an isolated CPU, so the timing-critical loop never
+ * shares a core with whoever submitted the frame.
+ */
+static int rockchip_pwm_tx_thread(void *data)
+{
+	struct rockchip_pwm_chip *pc = data;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(pc->tx_wait, kthread_should_stop() ||
+					 rockchip_pwm_tx_pending(pc));
+		if (READ_ONCE(pc->tx_suspended))
+			continue;
+
+		rockchip_pwm_fx_run(pc);
+
+		/*
+		 * While a slot is shown, queued frames go straight to the
+		 * staging frame, so blocked writers move on; the latest one
+		 * is sent when the slot is dropped.
+		 */
+		if (atomic_read(&pc->slot_show))
+			while (rockchip_pwm_queue_pop(pc))
+				;
+
+		if (!rockchip_pwm_tx_pending(pc) || rockchip_pwm_dither_wait(pc))
+			continue;
+
+		/* one frame per refresh, a timed one held back stays put */
+		if (!atomic_read(&pc->slot_show) && !READ_ONCE(pc->tx_held) &&
+		    !ledstrip_tribuf_fresh(&pc->frame_idx))
+			rockchip_pwm_queue_pop(pc);
+
+		/* a timed frame: wait for its time, unless overtaken meanwhile */
+		if (rockchip_pwm_present_wait(pc))
+			continue;
+
+		rockchip_pwm_tx_lock(pc);
+		if (!pc->tx_suspended) {
+			WRITE_ONCE(pc->tx_resend, false);
+			rockchip_pwm_strip_transmit(pc, &pc->chip.pwms[0]);
+		}
+		mutex_unlock(&pc->tx_lock);
+	}
+
+	return 0;
+}
+
+static int rockchip_pwm_tx_thread_start(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	int cpu = tx_cpu;
+	u32 val;
+
+	init_waitqueue_head(&pc->tx_wait);
+
+	pc->tx_thread = kthread_create(rockchip_pwm_tx_thread, pc, "ledstrip/%s",
+				       dev_name(dev));
+	if (IS_ERR(pc->tx_thread))
+		return PTR_ERR(pc->tx_thread);
+
+	if (!device_property_read_u32(dev, "rockchip,ledstrip-cpu", &val))
+		cpu = val;
+	if (cpu >= 0 && cpu < nr_cpu_ids && cpu_online(cpu))
+		kthread_bind(pc->tx_thread, cpu);
+	else if (cpu >= 0)
+		dev_warn(dev, "Ledstrip CPU %d is not online, not binding\n", cpu);
+
+	sched_set_fifo(pc->tx_thread);
+	wake_up_process(pc->tx_thread);
+
+	return 0;
+}
+
+/*
+ * The strip owns the channel's period and duty, a frame sets them up and
+ * stops the channel again once it is out. Enabling sends the current
+ * frame; disabling has nothing left to stop.
+ */
+static int rockchip_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+			      const struct pwm_state *state)
+{
+	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
+	int ret;
+
+	if (!state->enabled)
+		return 0;
+
+	rockchip_pwm_tx_lock(pc);
+	ret = rockchip_pwm_strip_transmit(pc, pwm);
+	mutex_unlock(&pc->tx_lock);
+
+	return ret;
+}
+
+/*
+ * Target of a timed frame as CLOCK_MONOTONIC ns, 0 if it is invalid.
+ * CLOCK_TAI targets are converted with the offset as it is now, which
+ * tracks PTP once the system clock is disciplined to it (phc2sys).
+ */
+static u64 rockchip_pwm_present_target(const struct ledstrip_timed_frame *timed)
+{
+	u64 target;
+	s64 offset;
+
+	switch (timed->clock) {
+	case CLOCK_MONOTONIC:
+		target = timed->present_ns;
+		break;
+	case CLOCK_TAI:
+		offset = ktime_get_clocktai_ns() - ktime_get_ns();
+		if (timed->present_ns <= offset)
+			return 0;
+		target = timed->present_ns - offset;
+		break;
+	default:
+		return 0;
+	}
+
+	/* a target far off would hold the strip for that long */
+	if (target > ktime_get_ns() + PRESENT_HORIZON_NS)
+		return 0;
+
+	return target;
+}
+
+/*
+ * First frame from DT, published as soon as the transmit thread is up, so
+ * the strip lights long before userspace does; with
+ * CONFIG_ROCKCHIP_THUNDER_BOOT the driver probes at subsys_initcall.
+ * "rockchip,ledstrip-boot-frame" is R, G, B bytes, repeated along the
+ * strip. Otherwise "rockchip,ledstrip-boot-colors" holds one or two
+ * 0xRRGGBB, shown as "rockchip,ledstrip-boot-effect" ("static" unless
+ * given, "gradient" or "rainbow") moving at "rockchip,ledstrip-boot-speed"
+ * cycles per minute until userspace sends its first frame. Probe only
+ * publishes; the transmit thread does the sending.
+ */
+static void rockchip_pwm_boot_frame(struct rockchip_pwm_chip *pc)
+{
+	struct device *dev = pc->chip.dev;
+	struct ledstrip_effect effect = { .mode = LEDSTRIP_EFFECT_STATIC };
+	size_t i, bytes = pc->leds * LED_BYTES;
+	const char *name;
+	int n, ret = 0;
+	u8 *rgb;
+
+	rgb = kmalloc(bytes, GFP_KERNEL);
+	if (!rgb)
+		return;
+
+	n = device_property_count_u8(dev, "rockchip,ledstrip-boot-frame");
+	if (n >= LED_BYTES) {
+		n = min_t(size_t, n - n % LED_BYTES, bytes);
+		ret = device_property_read_u8_array(dev,
+				"rockchip,ledstrip-boot-frame", rgb, n);
+		for (i = n; i < bytes; i++)
+			rgb[i] = rgb[i - n];
+		if (!ret)
+			ret = rockchip_pwm_frame_submit(pc, rgb, bytes, 0);
+		goto out;
+	}
+
+	n = device_property_count_u32(dev, "rockchip,ledstrip-boot-colors");
+	if (n <= 0)
+		goto out;
+	ret = device_property_read_u32_array(dev, "rockchip,ledstrip-boot-colors",
+					     effect.colors, min(n, 2));
+	if (ret)
+		goto out;
+	if (n == 1)
+		effect.colors[1] = effect.colors[0];
+
+	if (!device_property_read_string(dev, "rockchip,ledstrip-boot-effect",
+					 &name)) {
+		ret = match_string(rockchip_pwm_fx_names,
+				   ARRAY_SIZE(rockchip_pwm_fx_names), name);
+		if (ret < 0)
+			goto out;
+		effect.mode = ret;
+	}
+	device_property_read_u32(dev, "rockchip,ledstrip-boot-speed",
+				 &effect.speed);
+
+	/* a plain colour is one frame, no need to keep rendering it */
+	if (effect.mode == LEDSTRIP_EFFECT_STATIC) {
+		for (i = 0; i < bytes; i++)
+			rgb[i] = effect.colors[0] >> (16 - 8 * (i % LED_BYTES));
+		ret = rockchip_pwm_frame_submit(pc, rgb, bytes, 0);
+		goto out;
+	}
+
+	ret = rockchip_pwm_fx_set(pc, &effect);
+	if (!ret)
+		atomic_set(&pc->fx_boot, 1);
+out:
+	if (ret)
+		dev_warn(dev, "Invalid ledstrip boot frame: %d\n", ret);
+	kfree(rgb);
+}
+
+/* Userspace has a frame for the strip, the boot effect makes way for it */
+static void rockchip_pwm_boot_fx_stop(struct rockchip_pwm_chip *pc)
+{
+	struct ledstrip_effect off = { .mode = LEDSTRIP_EFFECT_OFF };
+
+	if (atomic_read(&pc->fx_boot) && atomic_xchg(&pc->fx_boot, 0))
+		rockchip_pwm_fx_set(pc, &off);
+}
+
+static int rockchip_pwm_strip_submit(struct rockchip_pwm_chip *pc,
+				     const void __user *pixels, size_t len,
+				     u64 target_ns, bool nonblock)
+{
+	struct rockchip_pwm_qframe *qf;
+	size_t bytes = READ_ONCE(pc->leds) * LED_BYTES;
+	int ret;
+
+	/* 8 bits per channel, or 16 bits per channel to be dithered */
+	if (len != bytes && len != bytes * 2)
+		return -EINVAL;
+
+	/* Copy outside frame_lock, copy_from_user() may fault and sleep */
+	qf = kmalloc(struct_size(qf, pixels, len), GFP_KERNEL);
+	if (!qf)
+		return -ENOMEM;
+	if (copy_from_user(qf->pixels, pixels, len)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	qf->len = len;
+	qf->target_ns = target_ns;
+
+	rockchip_pwm_boot_fx_stop(pc);
+
+	ret = rockchip_pwm_queue_push(pc, qf, nonblock);
+	if (!ret)
+		return 0;
+	if (ret > 0)
+		ret = rockchip_pwm_frame_submit(pc, qf->pixels, len, target_ns);
+out:
+	kfree(qf);
+
+	return ret;
+}
+
+/*
+ * Update LEDs [start, start + count) of the last 8-bit frame. Only the
+ * changed LEDs are copied and encoded, and however many updates land
+ * between two refreshes, the strip is sent once with all of them.
+ */
+static int rockchip_pwm_strip_range(struct rockchip_pwm_chip *pc,
+				    const struct ledstrip_range *range)
+{
+	struct rockchip_pwm_frame *frame;
+	unsigned int leds = READ_ONCE(pc->leds);
+	unsigned long flags;
+	u8 *buf;
+
+	if (!range->count || range->start >= leds ||
+	    range->count > leds - range->start)
+		return -EINVAL;
+
+	buf = memdup_user(u64_to_user_ptr(range->pixels),
+			  range->count * LED_BYTES);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	rockchip_pwm_boot_fx_stop(pc);
+
+	frame = rockchip_pwm_frame_begin(pc, &flags);
+	if (range->start + range->count > pc->leds) {
+		rockchip_pwm_frame_cancel(pc, flags);
+		kfree(buf);
+		return -EINVAL;
+	}
+	memcpy(&pc->stage[range->start * LED_BYTES], buf,
+	       range->count * LED_BYTES);
+	rockchip_pwm_stage_mark(pc, range->start, range->count);
+	frame->deep = false;
+	rockchip_pwm_frame_publish(pc, flags);
+
+	kfree(buf);
+
+	return 0;
+}
+
+/*
+ * Change the strip length, protocol and colour order. The strip is
+ * blanked and anything queued for the old geometry is discarded.
+ */
+static int rockchip_pwm_strip_config_set(struct rockchip_pwm_chip *pc,
+					 const struct ledstrip_config *cfg)
+{
+	unsigned long flags;
+
+	if (!cfg->leds || cfg->leds > pc->leds_max ||
+	    cfg->protocol >= ARRAY_SIZE(rockchip_pwm_protocols) ||
+	    !rockchip_pwm_order_valid(cfg->order))
+		return -EINVAL;
+
+	/* no producer is encoding into the back buffer meanwhile */
+	mutex_lock(&pc->frame_mutex);
+	mutex_lock(&pc->tx_lock);
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	pc->leds = cfg->leds;
+	pc->proto = &rockchip_pwm_protocols[cfg->protocol];
+	memcpy(pc->wire_order, cfg->order, LED_BYTES);
+	rockchip_pwm_frame_reset(pc, 0);
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+	rockchip_pwm_slots_clear(pc);
+	rockchip_pwm_strip_timing(pc);
+	mutex_unlock(&pc->tx_lock);
+	mutex_unlock(&pc->frame_mutex);
+
+	rockchip_pwm_queue_flush(pc);
+
+	rockchip_pwm_frame_begin(pc, &flags);
+	rockchip_pwm_stage_mark(pc, 0, pc->leds);
+	rockchip_pwm_frame_publish(pc, flags);
+
+	return 0;
+}
+
+static void rockchip_pwm_strip_config_get(struct rockchip_pwm_chip *pc,
+					  struct ledstrip_config *cfg)
+{
+	unsigned long flags;
+
+	memset(cfg, 0, sizeof(*cfg));
+	spin_lock_irqsave(&pc->frame_lock, flags);
+	cfg->leds = pc->leds;
+	cfg->max_leds = pc->leds_max;
+	cfg->protocol = pc->proto - rockchip_pwm_protocols;
+	memcpy(cfg->order, pc->wire_order, LED_BYTES);
+	spin_unlock_irqrestore(&pc->frame_lock, flags);
+}
+
+static void rockchip_pwm_strip_ref_release(struct kref *ref)
+{
+	kfree(container_of(ref, struct rockchip_pwm_strip_ref, ref));
+}
+
+/*
+ * The chip behind @file with its reference locked for read, or NULL once
+ * the device is gone. A non-NULL chip is released with strip_unlock().
+ */
+static struct rockchip_pwm_chip *rockchip_pwm_strip_lock(struct file *file)
+{
+	struct rockchip_pwm_strip_ref *sr = file->private_data;
+
+	down_read(&sr->lock);
+	if (!sr->pc)
+		up_read(&sr->lock);
 
-static int rockchip_pwm_enable(struct pwm_chip *chip,
-			       struct pwm_device *pwm,
-			       bool enable)
+	return sr->pc;
+}
+
+static void rockchip_pwm_strip_unlock(struct file *file)
 {
-	struct rockchip_pwm_chip *pc = to_rockchip_pwm_chip(chip);
-	u32 enable_conf = pc->data->enable_conf;
+	struct rockchip_pwm_strip_ref *sr = file->private_data;
+
+	up_read(&sr->lock);
+}
+
+/* misc_open() calls this under misc_mtx, so the chip is still there */
+static int rockchip_pwm_strip_open(struct inode *inode, struct file *file)
+{
+	struct rockchip_pwm_chip *pc =
+		container_of(file->private_data, struct rockchip_pwm_chip, miscdev);
+
+	kref_get(&pc->strip_ref->ref);
+	file->private_data = pc->strip_ref;
+
+	return 0;
+}
+
+static int rockchip_pwm_strip_release(struct inode *inode, struct file *file)
+{
+	struct rockchip_pwm_strip_ref *sr = file->private_data;
+
+	kref_put(&sr->ref, rockchip_pwm_strip_ref_release);
+
+	return 0;
+}
+
+static ssize_t rockchip_pwm_strip_write(struct file *file,
+					const char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	struct rockchip_pwm_chip *pc = rockchip_pwm_strip_lock(file);
 	int ret;
-	u32 val;
 
-	//printk(KERN_INFO "[LIGHT] Enable/Disable PWM\n");
+	if (!pc)
+		return -ENODEV;
 
-	if (enable) 
-	{
-		ret = clk_enable(pc->clk);
-		if (ret)
-			return ret;
-	}
+	ret = rockchip_pwm_strip_submit(pc, buf, count, 0,
+					file->f_flags & O_NONBLOCK);
+	rockchip_pwm_strip_unlock(file);
 
-	val = readl_relaxed(pc->base + pc->data->regs.ctrl);
-	val &= ~pc->data->enable_conf_mask;
+	return ret ? ret : count;
+}
 
-	if (PWM_OUTPUT_CENTER & pc->data->enable_conf_mask) 
-	{
-		if (pc->center_aligned)
-			val |= PWM_OUTPUT_CENTER;
+static long __rockchip_pwm_strip_ioctl(struct rockchip_pwm_chip *pc,
+				       struct file *file, unsigned int cmd,
+				       unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct ledstrip_correction correction;
+	struct ledstrip_timed_frame timed;
+	struct ledstrip_sequence sequence;
+	struct ledstrip_status status;
+	struct ledstrip_config config;
+	struct ledstrip_effect effect;
+	struct ledstrip_slots slots;
+	struct ledstrip_frame frame;
+	struct ledstrip_range range;
+	unsigned long flags;
+	u64 target;
+	u32 slot;
+
+	switch (cmd) {
+	case LEDSTRIP_IOC_SET_FRAME:
+		if (copy_from_user(&frame, argp, sizeof(frame)))
+			return -EFAULT;
+		return rockchip_pwm_strip_submit(pc, u64_to_user_ptr(frame.pixels),
+						 frame.len, 0, file->f_flags & O_NONBLOCK);
+	case LEDSTRIP_IOC_SET_FRAME_AT:
+		if (copy_from_user(&timed, argp, sizeof(timed)))
+			return -EFAULT;
+		target = rockchip_pwm_present_target(&timed);
+		if (!target)
+			return -EINVAL;
+		return rockchip_pwm_strip_submit(pc, u64_to_user_ptr(timed.pixels),
+						 timed.len, target,
+						 file->f_flags & O_NONBLOCK);
+	case LEDSTRIP_IOC_SET_RANGE:
+		if (copy_from_user(&range, argp, sizeof(range)))
+			return -EFAULT;
+		return rockchip_pwm_strip_range(pc, &range);
+	case LEDSTRIP_IOC_SET_EFFECT:
+		if (copy_from_user(&effect, argp, sizeof(effect)))
+			return -EFAULT;
+		atomic_set(&pc->fx_boot, 0);
+		return rockchip_pwm_fx_set(pc, &effect);
+	case LEDSTRIP_IOC_GET_EFFECT:
+		spin_lock_irqsave(&pc->frame_lock, flags);
+		effect = pc->fx.params;
+		spin_unlock_irqrestore(&pc->frame_lock, flags);
+		if (copy_to_user(argp, &effect, sizeof(effect)))
+			return -EFAULT;
+		return 0;
+	case LEDSTRIP_IOC_SET_CORRECTION:
+		if (copy_from_user(&correction, argp, sizeof(correction)))
+			return -EFAULT;
+		rockchip_pwm_lut_set(pc, &correction);
+		return 0;
+	case LEDSTRIP_IOC_GET_CORRECTION:
+		mutex_lock(&pc->tx_lock);
+		correction = pc->correction;
+		mutex_unlock(&pc->tx_lock);
+		if (copy_to_user(argp, &correction, sizeof(correction)))
+			return -EFAULT;
+		return 0;
+	case LEDSTRIP_IOC_SET_CONFIG:
+		if (copy_from_user(&config, argp, sizeof(config)))
+			return -EFAULT;
+		return rockchip_pwm_strip_config_set(pc, &config);
+	case LEDSTRIP_IOC_GET_CONFIG:
+		rockchip_pwm_strip_config_get(pc, &config);
+		if (copy_to_user(argp, &config, sizeof(config)))
+			return -EFAULT;
+		return 0;
+	case LEDSTRIP_IOC_LOAD_SLOTS:
+		if (copy_from_user(&slots, argp, sizeof(slots)))
+			return -EFAULT;
+		return rockchip_pwm_slots_load(pc, &slots);
+	case LEDSTRIP_IOC_SHOW_SLOT:
+		if (get_user(slot, (u32 __user *)argp))
+			return -EFAULT;
+		return rockchip_pwm_slot_select(pc, slot);
+	case LEDSTRIP_IOC_PLAY:
+		if (copy_from_user(&sequence, argp, sizeof(sequence)))
+			return -EFAULT;
+		return rockchip_pwm_seq_play(pc, &sequence);
+	case LEDSTRIP_IOC_GET_STATUS:
+		spin_lock_irqsave(&pc->frame_lock, flags);
+		status = pc->status;
+		status.published = pc->frame_seq;
+		spin_unlock_irqrestore(&pc->frame_lock, flags);
+		if (copy_to_user(argp, &status, sizeof(status)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOTTY;
 	}
+}
 
-	if (enable) {
-		val |= enable_conf;
-		if (pc->oneshot)
-			val &= ~PWM_CONTINUOUS;
-	} else {
-		val &= ~enable_conf;
-	}
+static long rockchip_pwm_strip_ioctl(struct file *file, unsigned int cmd,
+				     unsigned long arg)
+{
+	struct rockchip_pwm_chip *pc = rockchip_pwm_strip_lock(file);
+	long ret;
 
-	writel_relaxed(val, pc->base + pc->data->regs.ctrl);
-	if (pc->data->vop_pwm)
-		pc->vop_pwm_en = enable;
+	if (!pc)
+		return -ENODEV;
 
-	if (!enable)
-		clk_disable(pc->clk);
+	ret = __rockchip_pwm_strip_ioctl(pc, file, cmd, arg);
+	rockchip_pwm_strip_unlock(file);
 
-	return 0;
+	return ret;
 }
 
-static int rockchip_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm,
-			      const struct pwm_state *state)
+static const struct file_operations rockchip_pwm_strip_fops = {
+	.owner = THIS_MODULE,
+	.open = rockchip_pwm_strip_open,
+	.release = rockchip_pwm_strip_release,
+	.write = rockchip_pwm_strip_write,
+	.unlocked_ioctl = rockchip_pwm_strip_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = no_llseek,
+};
+
+static ssize_t chunk_leds_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
 {
-	struct rockchip_pwm_chip *pc;
-	struct pwm_state curstate;
-	struct pwm_state strip_state;
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
 
-	ktime_t start_time, end_time;//, loop_time;
-	ktime_t t1,t2,t3,t4,t5,t6,t7;
+	return sysfs_emit(buf, "%u\n", READ_ONCE(pc->chunk_leds));
+}
 
-	unsigned long flags, d0, d1;
-	void __iomem *ctrl_regs, *ctrl_regs_base, *duty_regs;
-	bool enabled;
+/* Worst-case interrupts-off time of the mmio backend, in LEDs */
+static ssize_t chunk_leds_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	unsigned int leds;
+	int ret;
 
-	int ret, bit_index;
-	u16 i, k, l;
-	u64 div;
-	u32 ctrl, crtl_lock_enabled; //, mask;
-	u32 time_to_tell_the_time, time_for_first_loop, time_to_run_delay_command, time_to_convert_time, sleep_time;
-
-	const bool pb_green[24] = {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
-	unsigned long pb_all[LEDS * LED_BITS];
-
-	printk(KERN_INFO "[LIGHT] Entering main PWM apply function...");
-
-	pc = to_rockchip_pwm_chip(chip);
-
-	t1 = ktime_get();
-	t2 = ktime_get();
-	t3 = ktime_get();
-
-	time_to_tell_the_time = ktime_to_ns(ktime_sub(t3, t2));
-	printk(KERN_INFO "TIME (for ktime_get): %u",time_to_tell_the_time);
-
-	ndelay( 10 );
-
-	t4 = ktime_get();
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-		ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	ndelay( 10 );
-	t5 = ktime_get();
-
-	printk(KERN_INFO "TIME (for 20x ndelay): %llu", ktime_to_ns(ktime_sub(t5,t4)));
-
-	t6 = ktime_get();
-	time_to_run_delay_command = ( ktime_to_ns(ktime_sub(t5,t4)) - 200 - time_to_tell_the_time ) / 20;
-	t7 = ktime_get();
-
-	printk(KERN_INFO "TIME (for 1x ndelay): %u",time_to_run_delay_command);
-
-	time_to_convert_time = ktime_to_ns(ktime_sub(t6,t7));
-	time_for_first_loop = 1200 + time_to_tell_the_time + time_to_convert_time;
-	printk(KERN_INFO "TIME (first loop, includes ktime and convert time): %u",time_for_first_loop);
-
-	/* ENABLE PWM PERIPHERAL & APB CLOCKS*/
-	ret = clk_enable(pc->pclk);
-	if (ret) 
-	{
-		printk(KERN_INFO "[LIGHT] Failed to enable PWM APB clock");
+	ret = kstrtouint(buf, 0, &leds);
+	if (ret)
 		return ret;
-	}
+	if (!leds || leds > pc->leds_max)
+		return -EINVAL;
 
-	ret = clk_enable(pc->clk);
-	if (ret) 
-	{
-		printk(KERN_INFO "[LIGHT] Failed to enable PWM clock");
+	WRITE_ONCE(pc->chunk_leds, leds);
+
+	return count;
+}
+static DEVICE_ATTR_RW(chunk_leds);
+
+static ssize_t dither_fps_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(pc->dither_fps));
+}
+
+/* Refresh rate of a deep frame while its dithering has not converged */
+static ssize_t dither_fps_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	unsigned int fps;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &fps);
+	if (ret)
 		return ret;
-	}
+	if (!fps || fps > FX_FPS_MAX)
+		return -EINVAL;
 
-	strip_state.enabled = true;
-	strip_state.period = 1200;
-	strip_state.duty_cycle = 0;
+	WRITE_ONCE(pc->dither_fps, fps);
 
-	pwm_get_state(pwm, &curstate);
-	enabled = curstate.enabled;
+	return count;
+}
+static DEVICE_ATTR_RW(dither_fps);
 
-	rockchip_pwm_config(chip, pwm, &strip_state);
-	if (strip_state.enabled != enabled) {
-		ret = rockchip_pwm_enable(chip, pwm, strip_state.enabled);
-		if (ret)
-			goto out;
+static ssize_t queue_policy_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	unsigned int policy = READ_ONCE(pc->queue_policy);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rockchip_pwm_queue_policies); i++)
+		len += sysfs_emit_at(buf, len, i == policy ? "[%s] " : "%s ",
+				     rockchip_pwm_queue_policies[i]);
+	buf[len - 1] = '\n';
+
+	return len;
+}
+
+static ssize_t queue_policy_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	struct rockchip_pwm_qframe *qf;
+	int policy;
+
+	policy = sysfs_match_string(rockchip_pwm_queue_policies, buf);
+	if (policy < 0)
+		return policy;
+
+	spin_lock(&pc->queue_lock);
+	WRITE_ONCE(pc->queue_policy, policy);
+	/* there is no queue under QUEUE_LATEST, what is left in it is dropped */
+	if (policy == QUEUE_LATEST) {
+		while (kfifo_get(&pc->queue, &qf)) {
+			kfree(qf);
+			pc->queue_drops++;
+		}
 	}
+	spin_unlock(&pc->queue_lock);
 
-	if (strip_state.enabled)
-		ret = pinctrl_select_state(pc->pinctrl, pc->active_state);
+	/* blocked writers re-check against the new policy */
+	wake_up_interruptible(&pc->queue_wait);
 
-	div = (u64)pc->clk_rate * T0L;
-	d0 = DIV_ROUND_CLOSEST_ULL(div, pc->data->prescaler * NSEC_PER_SEC);
-	div = (u64)pc->clk_rate * T1L;
-	d1 = DIV_ROUND_CLOSEST_ULL(div, pc->data->prescaler * NSEC_PER_SEC);
-	ctrl = readl_relaxed(pc->base + pc->data->regs.ctrl); // read control register
-	crtl_lock_enabled = ctrl | PWM_LOCK_EN;
-	ctrl &= ~PWM_LOCK_EN;
-	ctrl_regs_base = pc->base;
-	ctrl_regs = ctrl_regs_base + pc->data->regs.ctrl;
-	duty_regs = ctrl_regs_base + pc->data->regs.duty;
-
-	//Construct master array from repeating bit array
-    for (i = 0; i < LEDS * LED_BITS; i++) 
-	{
-        bit_index = i % 24;
-        //mask = 1 << (23 - bit_index);
-		pb_all[i] = pb_green[bit_index] ? d1 : d0;
-		printk(KERN_INFO "%u", pb_all[i]);
-    }
+	return count;
+}
+static DEVICE_ATTR_RW(queue_policy);
 
-	local_irq_save(flags);
-	start_time = ktime_get();
+/* Frames waiting in the queue */
+static ssize_t queue_depth_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
 
-	for (k = 0; k < LEDS * LED_BITS; k++)
-	{
-		writel_relaxed(crtl_lock_enabled, ctrl_regs); // write ctrl register
-		writel(pb_all[k], duty_regs); // write duty cycle value
-		writel(ctrl, ctrl_regs); // write new lock enable value in ctrl register
-			/*	
-			if(k == 0) 
-			{	// 			  1200				   start time - current time 						 delay time (~600ns)
-				loop_time = ktime_get();
-				sleep_time = time_for_first_loop - ktime_to_ns(ktime_sub(loop_time, start_time)) - time_to_run_delay_command;
-			}
-			if( sleep_time > 0 && sleep_time < 1800 ) 
-			{
-				if(k == 0) 
-				{
-					if( sleep_time > time_to_tell_the_time ) 
-					{
-						ndelay( sleep_time - time_to_tell_the_time );
-					}
-				}
-				else  
-				{
-					ndelay( sleep_time );
-				}
-			}
-			*/
-	}
+	return sysfs_emit(buf, "%u\n", kfifo_len(&pc->queue));
+}
+static DEVICE_ATTR_RO(queue_depth);
 
-	udelay(15000);
+/* Frames discarded by the drop policies since probe */
+static ssize_t queue_drops_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	unsigned long drops;
 
-	end_time = ktime_get();
-	local_irq_restore(flags);
+	spin_lock(&pc->queue_lock);
+	drops = pc->queue_drops;
+	spin_unlock(&pc->queue_lock);
 
-	strip_state.enabled = false;
-	pwm_get_state(pwm, &curstate);
-	enabled = curstate.enabled;
-	
-	rockchip_pwm_config(chip, pwm, &strip_state);
-	if (strip_state.enabled != enabled) 
-	{
-		ret = rockchip_pwm_enable(chip, pwm, strip_state.enabled);
-		if (ret)
-			goto out;
-	}
+	return sysfs_emit(buf, "%lu\n", drops);
+}
+static DEVICE_ATTR_RO(queue_drops);
 
-	/*
-	writel_relaxed(crtl_lock_enabled, ctrl_regs); // write ctrl register
-	writel(d0, duty_regs); // write duty cycle value
-	writel(ctrl, ctrl_regs); // write new lock enable value in ctrl register
+/* Transmitter-side encode time of the last frame, only what changed is encoded */
+static ssize_t encode_ns_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
 
-	if (strip_state.enabled)
-		ret = pinctrl_select_state(pc->pinctrl, pc->active_state);
-	*/
+	return sysfs_emit(buf, "%llu\n", READ_ONCE(pc->stat_encode_ns));
+}
+static DEVICE_ATTR_RO(encode_ns);
 
-    printk(KERN_INFO "[LIGHT] Test completed in %lld ns\n", ktime_to_ns(ktime_sub(end_time, start_time)));
-	printk(KERN_INFO "[LIGHT] Sleep time %u\n", sleep_time);
-	/*
-	clk_disable(pc->clk);
-	clk_disable(pc->pclk);
-	*/
+/* Time the backend took to send the last frame */
+static ssize_t transmit_ns_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
 
+	return sysfs_emit(buf, "%llu\n", READ_ONCE(pc->stat_tx_ns));
+}
+static DEVICE_ATTR_RO(transmit_ns);
 
-out:
-	clk_disable(pc->clk);
-	clk_disable(pc->pclk);
+/*
+ * Per-frame overhead of the PWM backends outside the wire time: runtime
+ * PM get and put, and starting and stopping the channel
+ */
+static ssize_t setup_ns_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
 
-	return ret;
+	return sysfs_emit(buf, "%llu\n", READ_ONCE(pc->stat_setup_ns));
+}
+static DEVICE_ATTR_RO(setup_ns);
+
+/* Frames the mmio backend aborted and resent after a stall, since probe */
+static ssize_t transmit_stalls_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%lu\n", READ_ONCE(pc->stat_stalls));
 }
+static DEVICE_ATTR_RO(transmit_stalls);
+
+static struct attribute *rockchip_pwm_strip_attrs[] = {
+	&dev_attr_chunk_leds.attr,
+	&dev_attr_dither_fps.attr,
+	&dev_attr_queue_policy.attr,
+	&dev_attr_queue_depth.attr,
+	&dev_attr_queue_drops.attr,
+	&dev_attr_encode_ns.attr,
+	&dev_attr_transmit_ns.attr,
+	&dev_attr_setup_ns.attr,
+	&dev_attr_transmit_stalls.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(rockchip_pwm_strip);
 
 static const struct pwm_ops rockchip_pwm_ops = {
 	.get_state = rockchip_pwm_get_state,
@@ -539,7 +3524,49 @@ static const struct pwm_ops rockchip_pwm_ops = {
 	.owner = THIS_MODULE,
 };
 
+/*
+ * The ops of each variant are instantiated below its data, and bind the
+ * common bodies to it so the compiler folds its flags and offsets in.
+ */
+#define ROCKCHIP_PWM_VARIANT(v)						\
+static void rockchip_pwm_config_##v(struct pwm_chip *chip,		\
+				    struct pwm_device *pwm,		\
+				    const struct pwm_state *state)	\
+{									\
+	__rockchip_pwm_config(chip, state, &pwm_data_##v);		\
+}									\
+									\
+static int rockchip_pwm_enable_##v(struct pwm_chip *chip,		\
+				   struct pwm_device *pwm, bool enable)	\
+{									\
+	return __rockchip_pwm_enable(chip, enable, &pwm_data_##v);	\
+}									\
+									\
+static bool rockchip_pwm_paced_next_##v(struct rockchip_pwm_chip *pc)	\
+{									\
+	return __rockchip_pwm_paced_next(pc, &pwm_data_##v);		\
+}									\
+									\
+static int rockchip_pwm_tx_mmio_##v(struct rockchip_pwm_chip *pc,	\
+				    const u32 *duty, unsigned int len)	\
+{									\
+	return __rockchip_pwm_tx_mmio(pc, duty, len, &pwm_data_##v);	\
+}									\
+									\
+static const struct rockchip_pwm_hw_ops rockchip_pwm_hw_##v = {		\
+	.config = rockchip_pwm_config_##v,				\
+	.enable = rockchip_pwm_enable_##v,				\
+	.paced_next = rockchip_pwm_paced_next_##v,			\
+	.tx_mmio = rockchip_pwm_tx_mmio_##v,				\
+}
+
+static const struct rockchip_pwm_hw_ops rockchip_pwm_hw_v1;
+static const struct rockchip_pwm_hw_ops rockchip_pwm_hw_v2;
+static const struct rockchip_pwm_hw_ops rockchip_pwm_hw_vop;
+static const struct rockchip_pwm_hw_ops rockchip_pwm_hw_v3;
+
 static const struct rockchip_pwm_data pwm_data_v1 = {
+	.ops = &rockchip_pwm_hw_v1,
 	.regs = {
 		.duty = 0x04,
 		.period = 0x08,
@@ -555,6 +3582,7 @@ static const struct rockchip_pwm_data pwm_data_v1 = {
 };
 
 static const struct rockchip_pwm_data pwm_data_v2 = {
+	.ops = &rockchip_pwm_hw_v2,
 	.regs = {
 		.duty = 0x08,
 		.period = 0x04,
@@ -571,6 +3599,7 @@ static const struct rockchip_pwm_data pwm_data_v2 = {
 };
 
 static const struct rockchip_pwm_data pwm_data_vop = {
+	.ops = &rockchip_pwm_hw_vop,
 	.regs = {
 		.duty = 0x08,
 		.period = 0x04,
@@ -587,6 +3616,7 @@ static const struct rockchip_pwm_data pwm_data_vop = {
 };
 
 static const struct rockchip_pwm_data pwm_data_v3 = {
+	.ops = &rockchip_pwm_hw_v3,
 	.regs = {
 		.duty = 0x08,
 		.period = 0x04,
@@ -602,6 +3632,11 @@ static const struct rockchip_pwm_data pwm_data_v3 = {
 	.enable_conf_mask = GENMASK(2, 0) | BIT(5) | BIT(8),
 };
 
+ROCKCHIP_PWM_VARIANT(v1);
+ROCKCHIP_PWM_VARIANT(v2);
+ROCKCHIP_PWM_VARIANT(vop);
+ROCKCHIP_PWM_VARIANT(v3);
+
 static const struct of_device_id rockchip_pwm_dt_ids[] = {
 	{ .compatible = "rockchip,rk2928-pwm", .data = &pwm_data_v1},
 	{ .compatible = "rockchip,rk3288-pwm", .data = &pwm_data_v2},
@@ -721,6 +3756,7 @@ static int rockchip_pwm_probe(struct platform_device *pdev)
 				resource_size(r));
 	if (IS_ERR(pc->base))
 		return PTR_ERR(pc->base);
+	pc->phys_base = r->start;
 
 	pc->clk = devm_clk_get(&pdev->dev, "pwm");
 	if (IS_ERR(pc->clk)) {
@@ -771,11 +3807,14 @@ static int rockchip_pwm_probe(struct platform_device *pdev)
 			//goto err_pclk;
 		}
 
-		ret = devm_request_irq(&pdev->dev, pc->irq, rockchip_pwm_oneshot_irq,
-				       IRQF_NO_SUSPEND | IRQF_SHARED,
-				       "rk_pwm_oneshot_irq", pc);
+		ret = devm_request_threaded_irq(&pdev->dev, pc->irq,
+						rockchip_pwm_oneshot_irq,
+						rockchip_pwm_oneshot_irq_thread,
+						IRQF_NO_SUSPEND | IRQF_SHARED,
+						"rk_pwm_oneshot_irq", pc);
 		if (ret) {
 			dev_err(&pdev->dev, "Claim oneshot IRQ failed\n");
+			pc->irq = ret;
 			//printk(KERN_INFO "[LIGHT] Claim oneshot IRQ failed (thanks Rockchip)\n");
 			//goto err_pclk;
 		}
@@ -798,40 +3837,125 @@ static int rockchip_pwm_probe(struct platform_device *pdev)
 	platform_set_drvdata(pdev, pc);
 
 	pc->data = id->data;
+	pc->hw = pc->data->ops;
 	pc->chip.dev = &pdev->dev;
 	pc->chip.ops = &rockchip_pwm_ops;
 	pc->chip.base = of_alias_get_id(pdev->dev.of_node, "pwm");
 	pc->chip.npwm = 1;
-	pc->clk_rate = clk_get_rate(pc->clk);
+	rockchip_pwm_rate_update(pc, clk_get_rate(pc->clk));
 
 	if (pc->data->supports_polarity) {
 		pc->chip.of_xlate = of_pwm_xlate_with_flags;
 		pc->chip.of_pwm_n_cells = 3;
 	}
 
+	rockchip_pwm_shadow_init(pc);
+
 	enable_conf = pc->data->enable_conf;
-	ctrl = readl_relaxed(pc->base + pc->data->regs.ctrl);
+	ctrl = pc->shadow.ctrl;
 	enabled = (ctrl & enable_conf) == enable_conf;
 
 	pc->center_aligned =
 		device_property_read_bool(&pdev->dev, "center-aligned");
 
+	mutex_init(&pc->tx_lock);
+	seqcount_mutex_init(&pc->lut_seq, &pc->tx_lock);
+
+	ret = rockchip_pwm_strip_config_init(pc);
+	if (ret)
+		goto err_pclk;
+
+	ret = rockchip_pwm_lut_init(pc);
+	if (ret)
+		goto err_pclk;
+
+	ret = rockchip_pwm_clk_notifier_register(pc);
+	if (ret)
+		goto err_pclk;
+
+	ret = rockchip_pwm_frame_init(pc);
+	if (ret)
+		goto err_pclk;
+
+	ret = rockchip_pwm_tx_init(pc);
+	if (ret)
+		goto err_pclk;
+
+	rockchip_pwm_queue_init(pc);
+	rockchip_pwm_fx_init(pc);
+	rockchip_pwm_slots_init(pc);
+
+	/*
+	 * Both clocks are running. Hand them to runtime PM, which gates them
+	 * once the strip has been idle for the autosuspend delay; a channel
+	 * that is already running keeps them until it is first stopped.
+	 */
+	pm_runtime_get_noresume(&pdev->dev);
+	if (enabled) {
+		pm_runtime_get_noresume(&pdev->dev);
+		pc->pm_boot_ref = true;
+	}
+	pm_runtime_set_autosuspend_delay(&pdev->dev, AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&pdev->dev);
+	pm_runtime_set_active(&pdev->dev);
+	pm_runtime_enable(&pdev->dev);
+
 	ret = pwmchip_add(&pc->chip);
 	if (ret < 0) {
 		dev_err(&pdev->dev, "pwmchip_add() failed: %d\n", ret);
-		goto err_pclk;
+		goto err_pm;
 	}
 
-	/* Keep the PWM clk enabled if the PWM appears to be up and running. */
-	if (!enabled)
-		clk_disable(pc->clk);
+	ret = rockchip_pwm_tx_thread_start(pc);
+	if (ret) {
+		dev_err(&pdev->dev, "Can't start transmit thread: %d\n", ret);
+		goto err_pwmchip;
+	}
 
-	clk_disable(pc->pclk);
+	rockchip_pwm_boot_frame(pc);
+
+	pc->miscdev.minor = MISC_DYNAMIC_MINOR;
+	pc->miscdev.name = devm_kasprintf(&pdev->dev, GFP_KERNEL, "ledstrip-%s",
+					  dev_name(&pdev->dev));
+	pc->miscdev.fops = &rockchip_pwm_strip_fops;
+	pc->miscdev.parent = &pdev->dev;
+	pc->strip_ref = kzalloc(sizeof(*pc->strip_ref), GFP_KERNEL);
+	if (!pc->miscdev.name || !pc->strip_ref) {
+		kfree(pc->strip_ref);
+		ret = -ENOMEM;
+		goto err_thread;
+	}
+	kref_init(&pc->strip_ref->ref);
+	init_rwsem(&pc->strip_ref->lock);
+	pc->strip_ref->pc = pc;
+
+	ret = misc_register(&pc->miscdev);
+	if (ret) {
+		dev_err(&pdev->dev, "misc_register() failed: %d\n", ret);
+		kfree(pc->strip_ref);
+		goto err_thread;
+	}
+
+	pm_runtime_mark_last_busy(&pdev->dev);
+	pm_runtime_put_autosuspend(&pdev->dev);
 
 	//strip_test(pc);
 
 	return 0;
 
+err_thread:
+	hrtimer_cancel(&pc->fx_timer);
+	kthread_stop(pc->tx_thread);
+err_pwmchip:
+	pwmchip_remove(&pc->chip);
+err_pm:
+	pm_runtime_disable(&pdev->dev);
+	pm_runtime_set_suspended(&pdev->dev);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
+	pm_runtime_put_noidle(&pdev->dev);
+	if (pc->pm_boot_ref)
+		pm_runtime_put_noidle(&pdev->dev);
+	rockchip_pwm_tx_exit(pc);
 err_pclk:
 	clk_disable_unprepare(pc->pclk);
 err_clk:
@@ -840,39 +3964,167 @@ err_clk:
 	return ret;
 }
 
+static int __maybe_unused rockchip_pwm_runtime_suspend(struct device *dev)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+
+	clk_disable(pc->clk);
+	clk_disable(pc->pclk);
+
+	return 0;
+}
+
+/*
+ * The block may have lost its registers while its clocks were off, put
+ * them back from the shadow before the next frame goes out
+ */
+static int __maybe_unused rockchip_pwm_runtime_resume(struct device *dev)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	struct rockchip_pwm_shadow *sh = &pc->shadow;
+	int ret;
+
+	ret = clk_enable(pc->pclk);
+	if (ret)
+		return ret;
+
+	ret = clk_enable(pc->clk);
+	if (ret) {
+		clk_disable(pc->pclk);
+		return ret;
+	}
+
+	if (pc->data->supports_lock)
+		writel_relaxed(sh->ctrl | PWM_LOCK_EN, pc->base + pc->data->regs.ctrl);
+	writel_relaxed(sh->period, pc->base + pc->data->regs.period);
+	writel_relaxed(sh->duty, pc->base + pc->data->regs.duty);
+	writel(sh->ctrl, pc->base + pc->data->regs.ctrl);
+	if (sh->int_en) {
+		sh->int_en = false;
+		rockchip_pwm_int_enable(pc, true);
+	}
+
+	return 0;
+}
+
+/*
+ * Across system sleep the transmit thread is held off, and the strip may
+ * lose power, so the last frame is sent again from memory on resume.
+ */
+static int __maybe_unused rockchip_pwm_suspend(struct device *dev)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+
+	mutex_lock(&pc->tx_lock);
+	pc->tx_suspended = true;
+	mutex_unlock(&pc->tx_lock);
+
+	return pm_runtime_force_suspend(dev);
+}
+
+static int __maybe_unused rockchip_pwm_resume(struct device *dev)
+{
+	struct rockchip_pwm_chip *pc = dev_get_drvdata(dev);
+	int ret;
+
+	ret = pm_runtime_force_resume(dev);
+
+	mutex_lock(&pc->tx_lock);
+	pc->tx_suspended = false;
+	pc->tx_resend = true;
+	mutex_unlock(&pc->tx_lock);
+	wake_up(&pc->tx_wait);
+
+	return ret;
+}
+
+static const struct dev_pm_ops rockchip_pwm_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(rockchip_pwm_suspend, rockchip_pwm_resume)
+	SET_RUNTIME_PM_OPS(rockchip_pwm_runtime_suspend,
+			   rockchip_pwm_runtime_resume, NULL)
+};
+
 static int rockchip_pwm_remove(struct platform_device *pdev)
 {
 	struct rockchip_pwm_chip *pc = platform_get_drvdata(pdev);
+	int ret;
+
+	/* no PWM user may reach ->apply once the backend is torn down */
+	ret = pwmchip_remove(&pc->chip);
+
+	/*
+	 * Files still open outlive the chip: wake blocked writers, wait for
+	 * calls in flight and cut the rest off.
+	 */
+	misc_deregister(&pc->miscdev);
+	WRITE_ONCE(pc->gone, true);
+	wake_up_all(&pc->queue_wait);
+	down_write(&pc->strip_ref->lock);
+	pc->strip_ref->pc = NULL;
+	up_write(&pc->strip_ref->lock);
+	kref_put(&pc->strip_ref->ref, rockchip_pwm_strip_ref_release);
+
+	hrtimer_cancel(&pc->fx_timer);
+	kthread_stop(pc->tx_thread);
+	mutex_lock(&pc->tx_lock);
+	rockchip_pwm_slots_clear(pc);
+	mutex_unlock(&pc->tx_lock);
+	rockchip_pwm_queue_flush(pc);
+	rockchip_pwm_tx_exit(pc);
+
+	pm_runtime_disable(&pdev->dev);
+	if (!pm_runtime_status_suspended(&pdev->dev)) {
+		clk_disable(pc->clk);
+		clk_disable(pc->pclk);
+		pm_runtime_set_suspended(&pdev->dev);
+	}
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
+	if (pc->pm_boot_ref)
+		pm_runtime_put_noidle(&pdev->dev);
 
 	clk_unprepare(pc->pclk);
 	clk_unprepare(pc->clk);
 
-	return pwmchip_remove(&pc->chip);
+	return ret;
 }
 
 static struct platform_driver rockchip_pwm_driver = {
 	.driver = {
 		.name = "rockchip-pwm",
 		.of_match_table = rockchip_pwm_dt_ids,
+		.dev_groups = rockchip_pwm_strip_groups,
+		.pm = &rockchip_pwm_pm_ops,
 	},
 	.probe = rockchip_pwm_probe,
 	.remove = rockchip_pwm_remove,
 };
-#ifdef CONFIG_ROCKCHIP_THUNDER_BOOT
+
 static int __init rockchip_pwm_driver_init(void)
 {
-	return platform_driver_register(&rockchip_pwm_driver);
+	int ret;
+
+	ret = spi_register_driver(&rockchip_pwm_spi_driver);
+	if (ret)
+		return ret;
+
+	ret = platform_driver_register(&rockchip_pwm_driver);
+	if (ret)
+		spi_unregister_driver(&rockchip_pwm_spi_driver);
+
+	return ret;
 }
+#ifdef CONFIG_ROCKCHIP_THUNDER_BOOT
 subsys_initcall(rockchip_pwm_driver_init);
+#else
+module_init(rockchip_pwm_driver_init);
+#endif
 
 static void __exit rockchip_pwm_driver_exit(void)
 {
 	platform_driver_unregister(&rockchip_pwm_driver);
+	spi_unregister_driver(&rockchip_pwm_spi_driver);
 }
 module_exit(rockchip_pwm_driver_exit);
-#else
-module_platform_driver(rockchip_pwm_driver);
-#endif
 
 MODULE_AUTHOR("Beniamino Galvani <b.galvani@gmail.com>, Helios Lyons <helios.lyons@disguise.one>");
 MODULE_DESCRIPTION("Adapted Rockchip SoC PWM driver for SK6812 LEDSTRIP");
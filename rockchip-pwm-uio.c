@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * UIO binding for a Rockchip PWM channel
+ *
+ * Exposes the channel's register window and its oneshot/period interrupt
+ * to userspace, so a userspace engine (uio_pwm_rk3568.c) can block on
+ * read() of /dev/uioN for completion events and refill the duty and
+ * repeat registers, instead of busy-polling a core.
+ *
+ * Bind it in place of rockchip-pwm-mod.c on the channel driving the strip:
+ *
+ *	pwm@fe6f0020 {
+ *		compatible = "rockchip,pwm-uio";
+ *		reg = <0x0 0xfe6f0020 0x0 0x10>;
+ *		interrupts = <GIC_SPI 84 IRQ_TYPE_LEVEL_HIGH>;
+ *		clocks = <&cru CLK_PWM2>, <&cru PCLK_PWM2>;
+ *		clock-names = "pwm", "pclk";
+ *	};
+ *
+ * Writing 1 or 0 to the UIO fd enables or disables the channel interrupt.
+ * The interrupt is acked here, each read() returns the running count of
+ * completed bursts.
+ *
+ * The channel sits idle from the end of one burst until userspace has
+ * been woken and has armed the next: interrupt, read() wakeup and a few
+ * register writes, tens of us here and of the order of the SK6812 reset
+ * time. The engine restarts any frame whose gap gets near that, so this
+ * path only keeps up with long-run data; the backends in
+ * rockchip-pwm-mod.c stream arbitrary frames without gaps.
+ */
+
+#include <linux/clk.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/spinlock.h>
+#include <linux/uio_driver.h>
+
+#define PWM_MAX_CHANNEL_NUM		4
+
+#define PWM_REG_INTSTS(n)		((3 - (n)) * 0x10 + 0x10)
+#define PWM_REG_INT_EN(n)		((3 - (n)) * 0x10 + 0x14)
+
+#define PWM_CH_INT(n)			BIT(n)
+
+struct rockchip_pwm_uio {
+	struct uio_info info;
+	struct clk *clk;
+	struct clk *pclk;
+	void __iomem *base;
+	spinlock_t lock;
+	int channel_id;
+};
+
+static int rockchip_pwm_uio_get_channel_id(const char *name)
+{
+	int len = strlen(name);
+
+	return name[len - 2] - '0';
+}
+
+static irqreturn_t rockchip_pwm_uio_irq(int irq, struct uio_info *info)
+{
+	struct rockchip_pwm_uio *pu = info->priv;
+	unsigned int id = pu->channel_id;
+	u32 val;
+
+	val = readl_relaxed(pu->base + PWM_REG_INTSTS(id));
+	if ((val & PWM_CH_INT(id)) == 0)
+		return IRQ_NONE;
+
+	/* Ack at the source, the event count tells userspace what happened */
+	writel_relaxed(PWM_CH_INT(id), pu->base + PWM_REG_INTSTS(id));
+
+	return IRQ_HANDLED;
+}
+
+static int rockchip_pwm_uio_irqcontrol(struct uio_info *info, s32 on)
+{
+	struct rockchip_pwm_uio *pu = info->priv;
+	unsigned int id = pu->channel_id;
+	unsigned long flags;
+	u32 int_ctrl;
+
+	spin_lock_irqsave(&pu->lock, flags);
+	int_ctrl = readl_relaxed(pu->base + PWM_REG_INT_EN(id));
+	if (on)
+		int_ctrl |= PWM_CH_INT(id);
+	else
+		int_ctrl &= ~PWM_CH_INT(id);
+	writel_relaxed(int_ctrl, pu->base + PWM_REG_INT_EN(id));
+	spin_unlock_irqrestore(&pu->lock, flags);
+
+	return 0;
+}
+
+static int rockchip_pwm_uio_probe(struct platform_device *pdev)
+{
+	struct rockchip_pwm_uio *pu;
+	struct resource *r;
+	int ret, irq;
+
+	pu = devm_kzalloc(&pdev->dev, sizeof(*pu), GFP_KERNEL);
+	if (!pu)
+		return -ENOMEM;
+
+	r = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	if (!r)
+		return -EINVAL;
+
+	pu->base = devm_ioremap(&pdev->dev, r->start, resource_size(r));
+	if (!pu->base)
+		return -ENOMEM;
+
+	pu->channel_id = rockchip_pwm_uio_get_channel_id(pdev->dev.of_node->full_name);
+	if (pu->channel_id < 0 || pu->channel_id >= PWM_MAX_CHANNEL_NUM) {
+		dev_err(&pdev->dev, "Channel id is out of range: %d\n", pu->channel_id);
+		return -EINVAL;
+	}
+
+	irq = platform_get_irq(pdev, 0);
+	if (irq < 0)
+		return irq;
+
+	pu->clk = devm_clk_get(&pdev->dev, "pwm");
+	if (IS_ERR(pu->clk))
+		return dev_err_probe(&pdev->dev, PTR_ERR(pu->clk),
+				     "Can't get bus clk\n");
+
+	pu->pclk = devm_clk_get(&pdev->dev, "pclk");
+	if (IS_ERR(pu->pclk))
+		pu->pclk = pu->clk;
+
+	/* Userspace owns the registers from here on, keep them clocked */
+	ret = clk_prepare_enable(pu->clk);
+	if (ret) {
+		dev_err(&pdev->dev, "Can't prepare enable bus clk: %d\n", ret);
+		return ret;
+	}
+
+	ret = clk_prepare_enable(pu->pclk);
+	if (ret) {
+		dev_err(&pdev->dev, "Can't prepare enable APB clk: %d\n", ret);
+		goto err_clk;
+	}
+
+	spin_lock_init(&pu->lock);
+
+	/* Start with the channel interrupt masked until userspace asks */
+	rockchip_pwm_uio_irqcontrol(&pu->info, 0);
+
+	pu->info.name = "rockchip-pwm-uio";
+	pu->info.version = "0.1";
+	pu->info.priv = pu;
+	/*
+	 * UIO maps whole pages. The page holds the block's shared INTSTS and
+	 * INT_EN too; the channel sits at maps/map0/offset within it.
+	 */
+	pu->info.mem[0].name = "pwm";
+	pu->info.mem[0].addr = r->start & PAGE_MASK;
+	pu->info.mem[0].offs = r->start & ~PAGE_MASK;
+	pu->info.mem[0].size = PAGE_SIZE;
+	pu->info.mem[0].memtype = UIO_MEM_PHYS;
+	pu->info.irq = irq;
+	pu->info.irq_flags = IRQF_SHARED;
+	pu->info.handler = rockchip_pwm_uio_irq;
+	pu->info.irqcontrol = rockchip_pwm_uio_irqcontrol;
+
+	ret = uio_register_device(&pdev->dev, &pu->info);
+	if (ret) {
+		dev_err(&pdev->dev, "uio_register_device() failed: %d\n", ret);
+		goto err_pclk;
+	}
+
+	platform_set_drvdata(pdev, pu);
+
+	return 0;
+
+err_pclk:
+	clk_disable_unprepare(pu->pclk);
+err_clk:
+	clk_disable_unprepare(pu->clk);
+
+	return ret;
+}
+
+static int rockchip_pwm_uio_remove(struct platform_device *pdev)
+{
+	struct rockchip_pwm_uio *pu = platform_get_drvdata(pdev);
+
+	uio_unregister_device(&pu->info);
+	rockchip_pwm_uio_irqcontrol(&pu->info, 0);
+
+	clk_disable_unprepare(pu->pclk);
+	clk_disable_unprepare(pu->clk);
+
+	return 0;
+}
+
+static const struct of_device_id rockchip_pwm_uio_dt_ids[] = {
+	{ .compatible = "rockchip,pwm-uio" },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, rockchip_pwm_uio_dt_ids);
+
+static struct platform_driver rockchip_pwm_uio_driver = {
+	.driver = {
+		.name = "rockchip-pwm-uio",
+		.of_match_table = rockchip_pwm_uio_dt_ids,
+	},
+	.probe = rockchip_pwm_uio_probe,
+	.remove = rockchip_pwm_uio_remove,
+};
+module_platform_driver(rockchip_pwm_uio_driver);
+
+MODULE_AUTHOR("Helios Lyons <helios.lyons@disguise.one>");
+MODULE_DESCRIPTION("UIO binding for Rockchip SoC PWM channels");
+MODULE_LICENSE("GPL v2");
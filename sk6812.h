@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * SK6812 protocol timing and wire encoding, shared by the kernel driver
+ * (rockchip-pwm-mod.c) and the userspace tools so every output path puts
+ * the same bits on the wire.
+ *
+ * Datasheet: https://cdn-shop.adafruit.com/product-files/1138/SK6812+LED+datasheet+.pdf
+ * T0H 0.3us, T1H 0.6us, bit period 1.2us, all +/- 0.15us; reset >= 80us
+ */
+
+#ifndef _SK6812_H
+#define _SK6812_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+// -------- Timing (ns) --------
+#define SK6812_LED_BITS			24
+#define SK6812_T0H				400 // Duty cycle high / low for 0
+#define SK6812_T0L				800
+#define SK6812_T1H				800 // Duty cycle high / low for 1
+#define SK6812_T1L				400
+#define SK6812_FPWM				(SK6812_T0H + SK6812_T0L) // PWM frequency (period)
+#define SK6812_RST				50000 // min. reset value
+#define SK6812_TOL				150 // +/- on every high and low time
+
+/* Wire order of the colour channels, as indices into R, G, B */
+#define SK6812_WIRE_ORDER		{ 1, 0, 2 } // GRB
+
+// -------- PWM Encoding --------
+/*
+ * The PWM path sends one SK6812_FPWM period per bit, MSB first, channels
+ * in SK6812_WIRE_ORDER. @d0 and @d1 are the duty words of a 0 and a 1:
+ * the ticks of SK6812_T0H and SK6812_T1H with positive duty polarity, or
+ * of SK6812_T0L and SK6812_T1L with negative duty polarity.
+ */
+static inline void sk6812_encode_byte(uint8_t level, uint32_t d0, uint32_t d1,
+				      uint32_t *duty)
+{
+	int b;
+
+	for (b = 0; b < 8; b++)
+		duty[b] = level & (0x80 >> b) ? d1 : d0;
+}
+
+/* Encode @leds pixels of R, G, B bytes into SK6812_LED_BITS duty words each */
+static inline void sk6812_encode_duty(const uint8_t *rgb, size_t leds,
+				      uint32_t d0, uint32_t d1, uint32_t *duty)
+{
+	static const uint8_t order[3] = SK6812_WIRE_ORDER;
+	size_t i;
+	int c;
+
+	for (i = 0; i < leds; i++, rgb += 3)
+		for (c = 0; c < 3; c++, duty += 8)
+			sk6812_encode_byte(rgb[order[c]], d0, d1, duty);
+}
+
+/*
+ * Table-driven sk6812_encode_duty(): @lut[ch][level] holds the eight duty
+ * words of a level of channel ch (R, G, B), with whatever correction the
+ * caller folded in. @order is the wire order, as indices into R, G, B.
+ */
+static inline void sk6812_encode_lut(const uint8_t *rgb, size_t leds,
+				     const uint8_t order[3],
+				     uint32_t (*const lut[3])[8], uint32_t *duty)
+{
+	size_t i;
+	int c;
+
+	for (i = 0; i < leds; i++, rgb += 3)
+		for (c = 0; c < 3; c++, duty += 8)
+			memcpy(duty, lut[order[c]][rgb[order[c]]], 8 * sizeof(*duty));
+}
+
+/* Bit @k on the wire for R, G, B pixels @rgb, in sk6812_encode_duty order */
+static inline bool sk6812_wire_bit(const uint8_t *rgb, size_t k)
+{
+	static const uint8_t order[3] = SK6812_WIRE_ORDER;
+	size_t byte = k / 8;
+
+	return rgb[byte - byte % 3 + order[byte % 3]] & (0x80 >> (k % 8));
+}
+
+// -------- SPI Encoding --------
+/*
+ * Over SPI each LED bit becomes a fixed run of SPI bits, high first. Two
+ * formats fit the timing tolerance:
+ *
+ *   3 bits @ 2.5 MHz: 0 = 100 (400ns high), 1 = 110 (800ns high)
+ *                     identical to the T0H/T1H of the PWM path
+ *   4 bits @ 3.2 MHz: 0 = 1000 (312ns high), 1 = 1100 (625ns high)
+ *                     centred on the datasheet values, the default
+ *
+ * MOSI must idle low; the frame is framed by zero bytes covering the
+ * reset time so the strip latches without any extra delay.
+ */
+struct sk6812_spi_format {
+	unsigned int bits;	/* SPI bits per LED bit */
+	uint32_t hz;		/* SPI clock */
+	uint8_t zero;		/* pattern for a 0, right aligned */
+	uint8_t one;		/* pattern for a 1, right aligned */
+};
+
+static const struct sk6812_spi_format sk6812_spi_3bit = { 3, 2500000, 0x4, 0x6 };
+static const struct sk6812_spi_format sk6812_spi_4bit = { 4, 3200000, 0x8, 0xc };
+
+/* Zero bytes sent either side of a frame: at least the reset time */
+static inline size_t sk6812_spi_reset_bytes(const struct sk6812_spi_format *f)
+{
+	/* twice the minimum, in us times kHz, so it stays in 32 bits */
+	uint32_t bits = (SK6812_RST * 2 / 1000) * (f->hz / 1000) / 1000;
+
+	return (bits + 7) / 8;
+}
+
+/* SPI bytes for @led_bytes bytes of wire-order LED data, without resets */
+static inline size_t sk6812_spi_frame_bytes(const struct sk6812_spi_format *f,
+					    size_t led_bytes)
+{
+	return (led_bytes * 8 * f->bits + 7) / 8;
+}
+
+struct sk6812_spi_writer {
+	const struct sk6812_spi_format *f;
+	uint8_t *out;
+	size_t len;
+	uint32_t acc;
+	unsigned int nbits;
+};
+
+static inline void sk6812_spi_begin(struct sk6812_spi_writer *w,
+				    const struct sk6812_spi_format *f,
+				    uint8_t *out)
+{
+	w->f = f;
+	w->out = out;
+	w->len = 0;
+	w->acc = 0;
+	w->nbits = 0;
+}
+
+/* Append the pattern of one LED bit */
+static inline void sk6812_spi_put(struct sk6812_spi_writer *w, bool one)
+{
+	w->acc = (w->acc << w->f->bits) | (one ? w->f->one : w->f->zero);
+	w->nbits += w->f->bits;
+	if (w->nbits >= 8) {
+		w->nbits -= 8;
+		w->out[w->len++] = w->acc >> w->nbits;
+	}
+}
+
+/* Pad the last partial byte with low bits, returns the bytes written */
+static inline size_t sk6812_spi_end(struct sk6812_spi_writer *w)
+{
+	if (w->nbits)
+		w->out[w->len++] = w->acc << (8 - w->nbits);
+	w->nbits = 0;
+
+	return w->len;
+}
+
+/*
+ * Encode @len bytes of wire-order LED data, MSB first, into @out, which
+ * must hold sk6812_spi_frame_bytes(). Returns the bytes written.
+ */
+static inline size_t sk6812_spi_encode(const struct sk6812_spi_format *f,
+				       const uint8_t *in, size_t len,
+				       uint8_t *out)
+{
+	struct sk6812_spi_writer w;
+	size_t i;
+	int b;
+
+	sk6812_spi_begin(&w, f, out);
+	for (i = 0; i < len; i++)
+		for (b = 7; b >= 0; b--)
+			sk6812_spi_put(&w, (in[i] >> b) & 1);
+
+	return sk6812_spi_end(&w);
+}
+
+#endif /* _SK6812_H */
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "sk6812.h"
+
+/*
+    SK6812 SPIDEV USERSPACE DRIVER
+    Drives the strip from a spare SPI controller through spidev. Each LED bit
+    becomes a fixed SPI bit pattern (see sk6812.h, shared with the kernel
+    driver) and the whole frame, reset gaps included, goes out as a single
+    SPI transfer, so the waveform is clocked by the controller rather than
+    the CPU.
+
+    Usage: spidev-sk6812 [-d /dev/spidevB.C] [-n leds] [-3] RRGGBB
+        -3  use the 3-bit pattern at 2.5 MHz instead of 4-bit at 3.2 MHz
+*/
+
+#define DEFAULT_DEVICE  "/dev/spidev0.0"
+#define DEFAULT_LEDS    57
+
+static const uint8_t wire_order[3] = SK6812_WIRE_ORDER;
+
+// ----- MGMT -----
+void FAIL(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+// ----- PIXELS -----
+// Fill the strip with one colour, reordered R, G, B -> wire order
+void fill_wire_frame(uint8_t *wire, int leds, uint32_t rgb)
+{
+    uint8_t px[3] = { rgb >> 16, rgb >> 8, rgb };
+
+    for (int i = 0; i < leds; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            wire[i * 3 + c] = px[wire_order[c]];
+        }
+    }
+}
+
+// ----- SPI -----
+int spi_open(const char *path, const struct sk6812_spi_format *f)
+{
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    uint32_t speed = f->hz;
+    int fd;
+
+    if ((fd = open(path, O_RDWR)) < 0)
+        FAIL("Failed to open spidev");
+
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0)
+        FAIL("Failed to set SPI mode");
+    if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+        FAIL("Failed to set SPI word size");
+    if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+        FAIL("Failed to set SPI speed");
+
+    return fd;
+}
+
+// Send one frame, framed by reset bytes, as a single transfer
+int spi_send_frame(int fd, const struct sk6812_spi_format *f, const uint8_t *wire, int leds)
+{
+    size_t reset = sk6812_spi_reset_bytes(f);
+    size_t len = 2 * reset + sk6812_spi_frame_bytes(f, leds * 3);
+    struct spi_ioc_transfer xfer;
+    uint8_t *buf;
+    int ret;
+
+    if ((buf = calloc(1, len)) == NULL)
+        FAIL("Failed to allocate SPI buffer");
+
+    sk6812_spi_encode(f, wire, leds * 3, buf + reset);
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (uintptr_t)buf;
+    xfer.len = len;
+    xfer.speed_hz = f->hz;
+    xfer.bits_per_word = 8;
+
+    ret = ioctl(fd, SPI_IOC_MESSAGE(1), &xfer);
+    free(buf);
+
+    return ret < 0 ? -1 : 0;
+}
+
+// ----- PROGRAM -----
+int main(int argc, char **argv)
+{
+    const struct sk6812_spi_format *f = &sk6812_spi_4bit;
+    const char *device = DEFAULT_DEVICE;
+    int leds = DEFAULT_LEDS;
+    uint32_t rgb;
+    uint8_t *wire;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "d:n:3")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            device = optarg;
+            break;
+        case 'n':
+            leds = atoi(optarg);
+            break;
+        case '3':
+            f = &sk6812_spi_3bit;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-n leds] [-3] RRGGBB\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc || leds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-d device] [-n leds] [-3] RRGGBB\n", argv[0]);
+        return 1;
+    }
+    rgb = strtoul(argv[optind], NULL, 16);
+
+    if ((wire = malloc(leds * 3)) == NULL)
+        FAIL("Failed to allocate frame");
+    fill_wire_frame(wire, leds, rgb);
+
+    fd = spi_open(device, f);
+    printf("[LIGHT] %d LEDs, %u-bit pattern at %u Hz on %s\n", leds, f->bits, f->hz, device);
+
+    if (spi_send_frame(fd, f, wire, leds) < 0)
+        FAIL("Failed to send frame");
+
+    close(fd);
+    free(wire);
+    return 0;
+}
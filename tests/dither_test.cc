@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Temporal dithering of deep frames (ledstrip-dither.h): the unrolled
+ * SWAR path must match the per-channel reference refresh after refresh,
+ * converge on the corrected level, and is timed against it.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+#include "ledstrip-dither.h"
+}
+
+namespace {
+
+/* 8.8 correction tables: a gamma-ish curve scaled per channel */
+struct Corr {
+	uint16_t table[3][257];
+	const uint16_t *ptr[3];
+
+	Corr()
+	{
+		static const unsigned int scale[3] = { 256, 200, 150 };
+
+		for (int c = 0; c < 3; c++) {
+			for (int v = 0; v < 256; v++)
+				table[c][v] = (uint32_t)v * v / 255 * scale[c];
+			table[c][256] = table[c][255];
+			ptr[c] = table[c];
+		}
+	}
+};
+
+std::vector<uint16_t> deep_pixels(size_t bytes)
+{
+	std::vector<uint16_t> rgb16(bytes);
+
+	for (size_t i = 0; i < bytes; i++)
+		rgb16[i] = uint16_t(i * 7919 + 1234);
+
+	return rgb16;
+}
+
+TEST(LedstripDither, MatchesTheReferenceOverRefreshes)
+{
+	static const Corr corr;
+
+	/* odd lengths leave a scalar tail after the unrolled steps */
+	for (size_t leds : { 1, 4, 5, 7, 300 }) {
+		size_t bytes = leds * 3;
+		std::vector<uint16_t> rgb16 = deep_pixels(bytes);
+		std::vector<uint16_t> err_ref(bytes), err(bytes);
+		std::vector<uint8_t> out_ref(bytes), out(bytes);
+
+		for (int refresh = 0; refresh < 300; refresh++) {
+			bool want = ledstrip_dither_scalar(rgb16.data(), bytes, corr.ptr,
+							   err_ref.data(), out_ref.data());
+			bool got = ledstrip_dither(rgb16.data(), bytes, corr.ptr,
+						   err.data(), out.data());
+
+			ASSERT_EQ(out, out_ref) << leds << " LEDs, refresh " << refresh;
+			ASSERT_EQ(err, err_ref) << leds << " LEDs, refresh " << refresh;
+			ASSERT_EQ(got, want);
+		}
+	}
+}
+
+TEST(LedstripDither, AveragesToTheCorrectedLevel)
+{
+	static const Corr corr;
+	const uint16_t rgb16[3] = { 0x1234, 0x8000, 0x0101 };
+	uint16_t err[3] = { };
+	uint8_t out[3];
+	unsigned int sum[3] = { };
+	const int refreshes = 256;
+
+	for (int r = 0; r < refreshes; r++) {
+		EXPECT_TRUE(ledstrip_dither(rgb16, 3, corr.ptr, err, out));
+		for (int c = 0; c < 3; c++)
+			sum[c] += out[c];
+	}
+
+	/* 256 refreshes of an 8.8 level add up to the level itself */
+	for (int c = 0; c < 3; c++) {
+		unsigned int level = ledstrip_dither_corr16(corr.ptr[c], rgb16[c]);
+
+		EXPECT_NEAR(sum[c], level, 1) << "channel " << c;
+	}
+}
+
+TEST(LedstripDither, StopsWithoutFractions)
+{
+	static const Corr corr;
+	const uint16_t rgb16[3] = { 0xffff, 0, 0 };
+	uint16_t err[3] = { };
+	uint8_t out[3];
+
+	EXPECT_FALSE(ledstrip_dither(rgb16, 3, corr.ptr, err, out));
+}
+
+template <typename F>
+double ns_per_led(F dither, size_t leds)
+{
+	static const Corr corr;
+	size_t bytes = leds * 3;
+	std::vector<uint16_t> rgb16 = deep_pixels(bytes), err(bytes);
+	std::vector<uint8_t> out(bytes);
+	double best = 1e30;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < 64; r++) {
+			dither(rgb16.data(), bytes, corr.ptr, err.data(), out.data());
+			asm volatile("" : : "r"(out.data()) : "memory");
+		}
+		auto t1 = std::chrono::steady_clock::now();
+
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() /
+					      64 / leds);
+	}
+
+	return best;
+}
+
+TEST(LedstripDither, Timing)
+{
+	const size_t leds = 4096;
+	double scalar = ns_per_led(ledstrip_dither_scalar, leds);
+	double fast = ns_per_led(ledstrip_dither, leds);
+
+	printf("%zu LEDs: scalar %.2f ns/LED, unrolled SWAR %.2f ns/LED (%.2fx)\n",
+	       leds, scalar, fast, scalar / fast);
+
+	/* loose: only catches the fast path falling behind the reference */
+	EXPECT_LT(fast, scalar * 1.5);
+}
+
+} // namespace
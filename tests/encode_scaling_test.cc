@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Encode and transmit cost against strip length for the table-driven
+ * encoder the kernel driver uses (sk6812_encode_lut), plus its agreement
+ * with the reference encoder. Transmit goes to a simulated channel whose
+ * counter runs off the monotonic clock at SK6812 timing, paced one duty
+ * word per period on the counter the way the mmio backend and
+ * direct_pwm_access_rk3568.c do. The timings are printed; the assertions
+ * only catch cost that grows faster than the strip, and transmit that
+ * takes far longer than its bit periods.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "sk6812.h"
+}
+
+namespace {
+
+constexpr uint32_t kD0 = 10, kD1 = 20;
+constexpr uint8_t kOrder[3] = SK6812_WIRE_ORDER;
+
+struct Lut {
+	uint32_t levels[256][8];
+
+	Lut()
+	{
+		for (int v = 0; v < 256; v++)
+			for (int b = 0; b < 8; b++)
+				levels[v][b] = (v >> (7 - b) & 1) ? kD1 : kD0;
+	}
+};
+
+std::vector<uint8_t> pixels(size_t leds)
+{
+	std::vector<uint8_t> rgb(leds * 3);
+
+	for (size_t i = 0; i < rgb.size(); i++)
+		rgb[i] = uint8_t(i * 37 + 11);
+
+	return rgb;
+}
+
+/* Best of several runs, in ns per LED */
+double encode_ns_per_led(const Lut &lut, size_t leds)
+{
+	uint32_t (*const tables[3])[8] = {
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+	};
+	std::vector<uint8_t> rgb = pixels(leds);
+	std::vector<uint32_t> duty(leds * SK6812_LED_BITS);
+	int reps = std::max<size_t>(1, 65536 / leds);
+	double best = 1e30;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < reps; r++) {
+			sk6812_encode_lut(rgb.data(), leds, kOrder, tables, duty.data());
+			asm volatile("" : : "r"(duty.data()) : "memory");
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+		best = std::min(best, ns / reps / leds);
+	}
+
+	return best;
+}
+
+/*
+ * Simulated channel: the counter free-runs at kClkHz and wraps at the
+ * period, duty writes land in a register the way they would on the block.
+ */
+struct SimChannel {
+	static constexpr uint64_t kClkHz = 24000000;
+	/* SK6812_FPWM rounded to whole ticks, as the driver programs it */
+	static constexpr uint32_t period = (SK6812_FPWM * kClkHz + 500000000) / 1000000000;
+	static constexpr double period_ns = period * 1e9 / kClkHz;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	volatile uint32_t duty = 0;
+
+	uint32_t counter() const
+	{
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		return uint64_t(ns) * kClkHz / 1000000000 % period;
+	}
+
+	/* One word per period: write it, then spin until the counter wraps */
+	void transmit(const uint32_t *words, size_t len)
+	{
+		uint32_t prev = counter(), cnt;
+
+		for (size_t k = 0; k < len; k++) {
+			duty = words[k];
+			while ((cnt = counter()) >= prev)
+				prev = cnt;
+			prev = cnt;
+		}
+		duty = 0;
+	}
+};
+
+/* Wall time of one paced transmit of @leds, in us */
+double transmit_us(const Lut &lut, size_t leds)
+{
+	uint32_t (*const tables[3])[8] = {
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+	};
+	std::vector<uint8_t> rgb = pixels(leds);
+	std::vector<uint32_t> duty(leds * SK6812_LED_BITS);
+	SimChannel sim;
+
+	sk6812_encode_lut(rgb.data(), leds, kOrder, tables, duty.data());
+	auto t0 = std::chrono::steady_clock::now();
+	sim.transmit(duty.data(), duty.size());
+	auto t1 = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::micro>(t1 - t0).count();
+}
+
+TEST(Sk6812EncodeLut, MatchesTheReferenceEncoder)
+{
+	static const Lut lut;
+	uint32_t (*const tables[3])[8] = {
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+		const_cast<uint32_t (*)[8]>(lut.levels),
+	};
+	std::vector<uint8_t> rgb = pixels(300);
+	std::vector<uint32_t> want(rgb.size() * 8), got(rgb.size() * 8);
+
+	sk6812_encode_duty(rgb.data(), 300, kD0, kD1, want.data());
+	sk6812_encode_lut(rgb.data(), 300, kOrder, tables, got.data());
+	EXPECT_EQ(got, want);
+}
+
+TEST(Sk6812EncodeLut, ScalesLinearlyWithLength)
+{
+	static const Lut lut;
+	double small = 0, large = 0, tx_small = 0, tx_large = 0;
+
+	for (size_t leds = 64; leds <= 4096; leds *= 2) {
+		double ns = encode_ns_per_led(lut, leds);
+		double tx_us = transmit_us(lut, leds);
+		/* 24 bit periods each, what the transmit can't beat */
+		double wire_us = leds * SK6812_LED_BITS * SimChannel::period_ns / 1000.0;
+
+		printf("%5zu LEDs: %6.2f ns/LED, %8.1f us encode, "
+		       "%8.1f us transmit (%8.1f us of bit periods)\n",
+		       leds, ns, ns * leds / 1000.0, tx_us, wire_us);
+		EXPECT_GT(tx_us, wire_us * 0.99) << leds << " LEDs";
+		EXPECT_LT(tx_us, wire_us * 2) << leds << " LEDs";
+		if (leds == 64) {
+			small = ns;
+			tx_small = tx_us / leds;
+		}
+		large = ns;
+		tx_large = tx_us / leds;
+	}
+
+	/* generous for noisy hosts; quadratic cost would be 64x */
+	EXPECT_LT(large, small * 8);
+	EXPECT_LT(tx_large, tx_small * 2);
+}
+
+} // namespace
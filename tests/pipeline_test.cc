@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Producer-side encode against the transmitter, as the driver pipelines
+ * them: a producer encodes each frame into the back buffer of the triple
+ * buffer (ledstrip-tribuf.h) and publishes it, while the transmitter
+ * sends the one before. The wire is a sleep here, as it is for the CPU
+ * with the DMA, SPI and interrupt backends; the mmio backend keeps its
+ * CPU busy, so there the overlap needs the transmit thread on a core of
+ * its own.
+ *
+ * The wire time is set to the encode time, where encoding on the
+ * transmitter would cost the most: serially a frame takes both, with
+ * the two overlapped only the longer one.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "ledstrip-tribuf.h"
+#include "sk6812.h"
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kLeds = 32768;
+constexpr int kFrames = 200;
+constexpr uint32_t kD0 = 10, kD1 = 20;
+constexpr uint8_t kOrder[3] = SK6812_WIRE_ORDER;
+
+struct Strip {
+	uint32_t levels[256][8];
+	uint32_t (*tables[3])[8];
+	std::vector<uint8_t> rgb;
+	struct ledstrip_tribuf idx;
+	std::vector<uint32_t> duty[LEDSTRIP_TRIBUF_BUFS];
+	std::mutex frame_mutex;
+
+	Strip() : rgb(kLeds * 3)
+	{
+		for (int v = 0; v < 256; v++)
+			for (int b = 0; b < 8; b++)
+				levels[v][b] = (v >> (7 - b) & 1) ? kD1 : kD0;
+		for (auto &t : tables)
+			t = levels;
+		ledstrip_tribuf_init(&idx);
+		for (auto &d : duty)
+			d.assign(kLeds * SK6812_LED_BITS, 0);
+	}
+
+	/* Frame @n: every channel at level n, encoded into @out */
+	void encode(int n, uint32_t *out)
+	{
+		memset(rgb.data(), n & 0xff, rgb.size());
+		sk6812_encode_lut(rgb.data(), kLeds, kOrder, tables, out);
+	}
+
+	/* The level an LED's first channel was encoded with */
+	static int level(const uint32_t *led)
+	{
+		int v = 0;
+
+		for (int b = 0; b < 8; b++)
+			v = v << 1 | (led[b] == kD1);
+		return v;
+	}
+};
+
+double us_since(Clock::time_point t0)
+{
+	return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+TEST(EncodePipeline, OverlapsEncodeWithTransmit)
+{
+	static Strip s;
+	std::atomic<bool> done{false};
+	std::atomic<int> torn{0}, skipped{0};
+	std::chrono::microseconds wire;
+	double encode_us = 1e30, serial_us, pipelined_us;
+	int sent = 0;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = Clock::now();
+
+		s.encode(run, s.duty[0].data());
+		encode_us = std::min(encode_us, us_since(t0));
+	}
+	wire = std::chrono::microseconds(int64_t(encode_us));
+
+	/* transmitter encodes, then sends */
+	auto t0 = Clock::now();
+	for (int n = 0; n < kFrames; n++) {
+		s.encode(n, s.duty[0].data());
+		std::this_thread::sleep_for(wire);
+	}
+	serial_us = us_since(t0);
+
+	/* producer encodes the next frame while the transmitter sends */
+	t0 = Clock::now();
+	std::thread tx([&] {
+		int last = -1;
+
+		while (!done.load(std::memory_order_acquire) || ledstrip_tribuf_fresh(&s.idx)) {
+			if (!ledstrip_tribuf_fresh(&s.idx)) {
+				std::this_thread::yield();
+				continue;
+			}
+			const uint32_t *d = s.duty[ledstrip_tribuf_acquire(&s.idx)].data();
+			int first = Strip::level(d);
+
+			if (Strip::level(d + (kLeds - 1) * SK6812_LED_BITS) != first)
+				torn++;
+			if (first != ((last + 1) & 0xff))
+				skipped++;
+			last = first;
+			sent++;
+			std::this_thread::sleep_for(wire);
+		}
+	});
+	for (int n = 0; n < kFrames; n++) {
+		std::lock_guard<std::mutex> lock(s.frame_mutex);
+
+		s.encode(n, s.duty[s.idx.back].data());
+		/* one frame in flight, as a refresh-paced producer keeps it */
+		while (ledstrip_tribuf_fresh(&s.idx))
+			std::this_thread::yield();
+		ledstrip_tribuf_publish(&s.idx);
+	}
+	done.store(true, std::memory_order_release);
+	tx.join();
+	pipelined_us = us_since(t0);
+
+	printf("%zu LEDs, %d frames: encode %.1f us, wire %lld us; "
+	       "serial %.1f us/frame, pipelined %.1f us/frame\n",
+	       kLeds, kFrames, encode_us, (long long)wire.count(),
+	       serial_us / kFrames, pipelined_us / kFrames);
+
+	EXPECT_EQ(torn.load(), 0);
+	EXPECT_EQ(skipped.load(), 0);
+	EXPECT_EQ(sent, kFrames);
+	/* overlapped, a frame costs the wire alone; serially up to twice that */
+	EXPECT_LT(pipelined_us, serial_us * 0.8);
+}
+
+} // namespace
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * SK6812 duty-word and SPI pattern generation (sk6812.h), as used by the
+ * kernel driver's PWM and SPI backends and by the userspace tools.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include "sk6812.h"
+}
+
+namespace {
+
+constexpr uint32_t kD0 = 10, kD1 = 20;
+
+std::vector<uint8_t> spi_encode(const sk6812_spi_format *f, const std::vector<bool> &bits)
+{
+	std::vector<uint8_t> out(sk6812_spi_frame_bytes(f, (bits.size() + 7) / 8) + 1);
+	struct sk6812_spi_writer w;
+
+	sk6812_spi_begin(&w, f, out.data());
+	for (bool b : bits)
+		sk6812_spi_put(&w, b);
+	out.resize(sk6812_spi_end(&w));
+
+	return out;
+}
+
+/* High time of one LED bit pattern, in ns */
+double pattern_high_ns(const sk6812_spi_format *f, uint8_t pattern)
+{
+	int high = 0;
+
+	for (unsigned int b = 0; b < f->bits; b++)
+		high += pattern >> b & 1;
+
+	return high * 1e9 / f->hz;
+}
+
+TEST(Sk6812Duty, EncodesMsbFirstInWireOrder)
+{
+	const uint8_t rgb[3] = { 0x01, 0x80, 0x00 };
+	uint32_t duty[SK6812_LED_BITS];
+
+	sk6812_encode_duty(rgb, 1, kD0, kD1, duty);
+
+	for (int i = 0; i < SK6812_LED_BITS; i++) {
+		/* GRB: green's MSB goes first, red's LSB ends the second byte */
+		uint32_t want = i == 0 || i == 15 ? kD1 : kD0;
+
+		EXPECT_EQ(duty[i], want) << "bit " << i;
+	}
+}
+
+TEST(Sk6812Duty, EncodesEveryLed)
+{
+	const uint8_t rgb[6] = { 0, 0, 0, 0xff, 0xff, 0xff };
+	uint32_t duty[2 * SK6812_LED_BITS];
+
+	sk6812_encode_duty(rgb, 2, kD0, kD1, duty);
+
+	for (int i = 0; i < SK6812_LED_BITS; i++) {
+		EXPECT_EQ(duty[i], kD0);
+		EXPECT_EQ(duty[SK6812_LED_BITS + i], kD1);
+	}
+}
+
+TEST(Sk6812Spi, ThreeBitPatterns)
+{
+	/* 0xa5 = 1010 0101: 110 100 110 100 100 110 100 110 */
+	std::vector<bool> bits = { 1, 0, 1, 0, 0, 1, 0, 1 };
+
+	EXPECT_EQ(spi_encode(&sk6812_spi_3bit, bits),
+		  (std::vector<uint8_t>{ 0xd3, 0x49, 0xa6 }));
+}
+
+TEST(Sk6812Spi, FourBitPatterns)
+{
+	/* 1100 1000 1100 1000 1000 1100 1000 1100 */
+	std::vector<bool> bits = { 1, 0, 1, 0, 0, 1, 0, 1 };
+
+	EXPECT_EQ(spi_encode(&sk6812_spi_4bit, bits),
+		  (std::vector<uint8_t>{ 0xc8, 0xc8, 0x8c, 0x8c }));
+}
+
+TEST(Sk6812Spi, PadsTheLastByteLow)
+{
+	EXPECT_EQ(spi_encode(&sk6812_spi_3bit, { 1 }), (std::vector<uint8_t>{ 0xc0 }));
+	EXPECT_EQ(spi_encode(&sk6812_spi_3bit, { 1, 1, 1 }),
+		  (std::vector<uint8_t>{ 0xdb, 0x00 }));
+	EXPECT_EQ(spi_encode(&sk6812_spi_4bit, { 0 }), (std::vector<uint8_t>{ 0x80 }));
+}
+
+TEST(Sk6812Spi, ThreeBitMatchesThePwmPath)
+{
+	EXPECT_DOUBLE_EQ(pattern_high_ns(&sk6812_spi_3bit, sk6812_spi_3bit.zero), SK6812_T0H);
+	EXPECT_DOUBLE_EQ(pattern_high_ns(&sk6812_spi_3bit, sk6812_spi_3bit.one), SK6812_T1H);
+	EXPECT_DOUBLE_EQ(sk6812_spi_3bit.bits * 1e9 / sk6812_spi_3bit.hz, SK6812_FPWM);
+}
+
+TEST(Sk6812Spi, FourBitWithinDatasheetTolerance)
+{
+	/* datasheet T0H 0.3us, T1H 0.6us, bit 1.2us, all +/- 0.15us */
+	EXPECT_NEAR(pattern_high_ns(&sk6812_spi_4bit, sk6812_spi_4bit.zero), 300, 150);
+	EXPECT_NEAR(pattern_high_ns(&sk6812_spi_4bit, sk6812_spi_4bit.one), 600, 150);
+	EXPECT_NEAR(sk6812_spi_4bit.bits * 1e9 / sk6812_spi_4bit.hz, 1200, 150);
+}
+
+TEST(Sk6812Spi, ResetCoversTwiceTheMinimum)
+{
+	for (const sk6812_spi_format *f : { &sk6812_spi_3bit, &sk6812_spi_4bit }) {
+		double ns = sk6812_spi_reset_bytes(f) * 8 * 1e9 / f->hz;
+
+		EXPECT_GE(ns, 2.0 * SK6812_RST) << f->bits << "-bit";
+		/* and not much more: one byte of rounding */
+		EXPECT_LT(ns, 2.0 * SK6812_RST + 8 * 1e9 / f->hz) << f->bits << "-bit";
+	}
+}
+
+TEST(Sk6812Spi, FrameBytes)
+{
+	EXPECT_EQ(sk6812_spi_frame_bytes(&sk6812_spi_3bit, 3), 9u);
+	EXPECT_EQ(sk6812_spi_frame_bytes(&sk6812_spi_4bit, 3), 12u);
+	EXPECT_EQ(sk6812_spi_frame_bytes(&sk6812_spi_3bit, 1), 3u);
+}
+
+} // namespace
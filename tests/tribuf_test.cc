@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Triple-buffer index handoff (ledstrip-tribuf.h): producer threads and a
+ * consumer thread hammer it as the driver's producers and transmitter do,
+ * and every frame the consumer sees must be whole and no older than the
+ * one before it. Several producers serialise on a mutex, standing in for
+ * the driver's frame_lock.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "ledstrip-tribuf.h"
+}
+
+namespace {
+
+constexpr size_t kFrameWords = 256;
+constexpr uint64_t kFrames = 200000;
+
+struct Frames {
+	struct ledstrip_tribuf idx;
+	std::vector<uint64_t> buf[LEDSTRIP_TRIBUF_BUFS];
+
+	Frames()
+	{
+		ledstrip_tribuf_init(&idx);
+		for (auto &b : buf)
+			b.assign(kFrameWords, 0);
+	}
+};
+
+TEST(Tribuf, InitialIndicesAreDistinctAndNotFresh)
+{
+	struct ledstrip_tribuf tb;
+
+	ledstrip_tribuf_init(&tb);
+	EXPECT_FALSE(ledstrip_tribuf_fresh(&tb));
+	EXPECT_EQ(ledstrip_tribuf_peek(&tb), -1);
+	EXPECT_NE(tb.back, tb.front);
+	EXPECT_EQ(ledstrip_tribuf_acquire(&tb), tb.front);
+}
+
+TEST(Tribuf, PublishThenAcquireHandsOverTheBackBuffer)
+{
+	struct ledstrip_tribuf tb;
+	unsigned int filled, front;
+
+	ledstrip_tribuf_init(&tb);
+	filled = tb.back;
+	ledstrip_tribuf_publish(&tb);
+	EXPECT_EQ(ledstrip_tribuf_peek(&tb), (int)filled);
+	EXPECT_NE(tb.back, filled);
+
+	front = ledstrip_tribuf_acquire(&tb);
+	EXPECT_EQ(front, filled);
+	EXPECT_FALSE(ledstrip_tribuf_fresh(&tb));
+
+	/* nothing new: the consumer keeps its buffer */
+	EXPECT_EQ(ledstrip_tribuf_acquire(&tb), front);
+}
+
+TEST(Tribuf, ConsumerSkipsToTheNewestFrame)
+{
+	struct ledstrip_tribuf tb;
+	unsigned int last = 0;
+
+	ledstrip_tribuf_init(&tb);
+	for (int i = 0; i < 5; i++) {
+		last = tb.back;
+		ledstrip_tribuf_publish(&tb);
+	}
+	EXPECT_EQ(ledstrip_tribuf_acquire(&tb), last);
+}
+
+TEST(Tribuf, NoTearingUnderContention)
+{
+	Frames f;
+	std::atomic<bool> stop{false};
+	uint64_t torn = 0, backwards = 0, seen = 0;
+
+	std::thread producer([&] {
+		for (uint64_t seq = 1; seq <= kFrames; seq++) {
+			std::vector<uint64_t> &b = f.buf[f.idx.back];
+
+			for (auto &w : b)
+				w = seq;
+			ledstrip_tribuf_publish(&f.idx);
+		}
+		stop.store(true, std::memory_order_release);
+	});
+
+	std::thread consumer([&] {
+		uint64_t prev = 0;
+
+		for (;;) {
+			bool last = stop.load(std::memory_order_acquire);
+			const std::vector<uint64_t> &b = f.buf[ledstrip_tribuf_acquire(&f.idx)];
+			uint64_t seq = b[0];
+
+			for (size_t i = 1; i < kFrameWords; i++)
+				if (b[i] != seq) {
+					torn++;
+					break;
+				}
+			if (seq < prev)
+				backwards++;
+			if (seq != prev)
+				seen++;
+			prev = seq;
+			if (last)
+				break;
+		}
+		/* the final frame is never lost */
+		EXPECT_EQ(prev, kFrames);
+	});
+
+	producer.join();
+	consumer.join();
+
+	EXPECT_EQ(torn, 0u);
+	EXPECT_EQ(backwards, 0u);
+	EXPECT_GT(seen, 1u);
+}
+
+TEST(Tribuf, NoTearingUnderConcurrentWriters)
+{
+	constexpr int kWriters = 4;
+	Frames f;
+	std::mutex frame_lock;
+	std::atomic<int> running{kWriters};
+	uint64_t published = 0, torn = 0, backwards = 0, seen = 0;
+	std::vector<std::thread> writers;
+
+	/*
+	 * Each writer fills the back buffer and publishes it under the lock,
+	 * as rockchip_pwm_frame_begin()/_publish() do, with the publish
+	 * order as the frame's content.
+	 */
+	for (int w = 0; w < kWriters; w++)
+		writers.emplace_back([&] {
+			for (uint64_t i = 0; i < kFrames / kWriters; i++) {
+				std::lock_guard<std::mutex> lock(frame_lock);
+				std::vector<uint64_t> &b = f.buf[f.idx.back];
+				uint64_t seq = ++published;
+
+				for (auto &word : b)
+					word = seq;
+				ledstrip_tribuf_publish(&f.idx);
+			}
+			running.fetch_sub(1, std::memory_order_release);
+		});
+
+	std::thread consumer([&] {
+		uint64_t prev = 0;
+
+		for (;;) {
+			bool last = running.load(std::memory_order_acquire) == 0;
+			const std::vector<uint64_t> &b = f.buf[ledstrip_tribuf_acquire(&f.idx)];
+			uint64_t seq = b[0];
+
+			for (size_t i = 1; i < kFrameWords; i++)
+				if (b[i] != seq) {
+					torn++;
+					break;
+				}
+			if (seq < prev)
+				backwards++;
+			if (seq != prev)
+				seen++;
+			prev = seq;
+			if (last)
+				break;
+		}
+		/* the newest frame of all writers is the one left on the strip */
+		EXPECT_EQ(prev, kFrames / kWriters * kWriters);
+	});
+
+	for (auto &t : writers)
+		t.join();
+	consumer.join();
+
+	EXPECT_EQ(torn, 0u);
+	EXPECT_EQ(backwards, 0u);
+	EXPECT_GT(seen, 1u);
+}
+
+} // namespace
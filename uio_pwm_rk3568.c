@@ -0,0 +1,602 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "sk6812.h"
+
+/*
+    SK6812 UIO USERSPACE DRIVER
+    Drives the strip through the rockchip-pwm-uio binding. Instead of
+    spinning on the counter like direct_pwm_access_rk3568.c, each run of
+    identical duty words is loaded as one oneshot burst and the thread
+    sleeps in read() on /dev/uioN until the channel interrupt says the burst
+    is done, then loads the next. Frames are encoded exactly as the kernel
+    driver does (sk6812.h).
+
+    Between bursts the channel is stopped and the line idles low, for as
+    long as the interrupt, the read() wakeup and the next register writes
+    take. That is tens of us on the RK3568, the same order as the SK6812
+    reset time, and SK6812 data changes value about every other bit. A
+    gap past BURST_GAP_NS aborts the frame, lets the strip latch and sends
+    it again, up to FRAME_RETRIES times. So this engine only gets arbitrary
+    frames through on a quiet, isolated core; it is meant for data with
+    long runs of identical bits (solid colours, RLE-friendly content).
+    The kernel driver's backends are the way to drive arbitrary frames.
+
+    Devices go through a pluggable backend: "uio" for the hardware, or
+    "sim", a memfd register page plus an eventfd standing in for the UIO
+    fd, with a thread playing the PWM channel: it runs each oneshot burst
+    for its real duration, records it, and raises the interrupt. The
+    engine can be exercised and checked on any Linux host.
+
+    Usage: uio_pwm_rk3568 [-s] [-u /dev/uioN] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB
+*/
+
+// -------- Debug --------
+#define DEBUG   1       // Print non-zero print debug
+
+// -------- Register Definitions --------
+// Offsets from the channel base, which sits at maps/map0/offset in the UIO page
+#define PWM_CNT_OFFSET          0x0000
+#define PWM_PERIOD_OFFSET       0x0004
+#define PWM_DUTY_OFFSET         0x0008
+#define PWM_CTRL_OFFSET         0x000C
+#define PWM_INTSTS_OFFSET(n)    ((3 - (n)) * 0x10 + 0x10)
+#define PWM_INT_EN_OFFSET(n)    ((3 - (n)) * 0x10 + 0x14)
+#define PWM_CH_INT(n)           (1 << (n))
+
+// -------- Register Configuration --------
+#define PWM_ENABLE			    (1 << 0)
+#define PWM_CONTINUOUS		    (1 << 1)
+#define PWM_DUTY_POSITIVE	    (1 << 3)
+#define PWM_INACTIVE_NEGATIVE	(0 << 4)
+#define PWM_INACTIVE_POSITIVE	(1 << 4)
+#define PWM_POLARITY_MASK	    (PWM_DUTY_POSITIVE | PWM_INACTIVE_POSITIVE)
+#define PWM_OUTPUT_LEFT		    (0 << 5)
+#define PWM_OUTPUT_CENTER	    (1 << 5)
+#define PWM_LOCK_EN		        (1 << 6)
+#define PWM_LP_DISABLE		    (0 << 8)
+#define PWM_ONESHOT_COUNT_SHIFT 24
+#define PWM_ONESHOT_COUNT_MASK  (0xff << PWM_ONESHOT_COUNT_SHIFT)
+#define PWM_ONESHOT_COUNT_MAX   256
+
+// -------- SK6812 Specification --------
+#define LEDS                    57           // Default number of LEDs
+#define PWM_CLK_HZ              24000000     // Default PWM clock, override with -r
+#define PWM_PRESCALER           1
+
+// -------- Real-Time --------
+#define RT_PRIORITY             80           // SCHED_FIFO priority
+#define PREFAULT_STACK          (64 * 1024)  // Stack touched before going real-time
+#define IRQ_TIMEOUT_MS          100          // Longest wait for one burst
+#define BURST_GAP_NS            (SK6812_RST / 2) // Longest idle line between bursts, well inside RST
+#define FRAME_RETRIES           3            // Frame restarts after a gap that was too long
+
+// -------- Memory Macros --------
+#define PAGE_SIZE         0x1000  // Size of memory page
+
+// ----- MGMT -----
+void FAIL(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+// ----- DEVICE BACKENDS -----
+struct burst
+{
+    uint32_t ctrl;
+    uint32_t period;
+    uint32_t duty;
+    uint32_t count;
+    uint64_t start_ns;              // CLOCK_MONOTONIC, line starts the first period
+    uint64_t end_ns;                // and goes idle after the last
+};
+
+struct uio_backend
+{
+    const char *name;
+    volatile uint32_t *regs;        // channel registers
+    int channel;
+    int fd;                         // polled for interrupt events
+    size_t event_size;              // bytes read per wakeup
+    void (*irq_enable)(struct uio_backend *ub, int on);
+    void (*close)(struct uio_backend *ub);
+    volatile uint64_t armed_ns;     // when the engine last set ENABLE
+
+    // sim only
+    void *page;
+    pthread_t thread;
+    volatile int stop;
+    uint32_t clk_hz;
+    struct burst *trace;            // every oneshot burst, in order
+    size_t trace_len;
+    size_t trace_cap;
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline uint32_t reg_read(struct uio_backend *ub, uint32_t offset)
+{
+    return ub->regs[offset / sizeof(uint32_t)];
+}
+
+static inline void reg_write(struct uio_backend *ub, uint32_t offset, uint32_t value)
+{
+    ub->regs[offset / sizeof(uint32_t)] = value;
+}
+
+// Block until the next interrupt event, -1 on timeout or error
+int irq_wait(struct uio_backend *ub)
+{
+    struct pollfd pfd = { .fd = ub->fd, .events = POLLIN };
+    uint64_t events = 0;
+
+    if (poll(&pfd, 1, IRQ_TIMEOUT_MS) <= 0)
+        return -1;
+    if (read(ub->fd, &events, ub->event_size) != (ssize_t)ub->event_size)
+        return -1;
+
+    return 0;
+}
+
+// The kernel side toggles the channel's INT_EN bit on a 4-byte write
+void uio_irq_enable(struct uio_backend *ub, int on)
+{
+    int32_t val = on;
+
+    if (write(ub->fd, &val, sizeof(val)) != sizeof(val))
+        perror("[LIGHT] WARNING: UIO irqcontrol");
+}
+
+void uio_close(struct uio_backend *ub)
+{
+    munmap(ub->page, PAGE_SIZE);
+    close(ub->fd);
+}
+
+unsigned long uio_map_offset(const char *device)
+{
+    const char *name = strrchr(device, '/');
+    char path[128];
+    unsigned long offset;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/class/uio/%s/maps/map0/offset", name ? name + 1 : device);
+    if ((f = fopen(path, "r")) == NULL)
+        FAIL("Error: can't read UIO map offset, is rockchip-pwm-uio bound?\n");
+    if (fscanf(f, "%lx", &offset) != 1)
+        FAIL("Error: bad UIO map offset\n");
+    fclose(f);
+
+    return offset;
+}
+
+void uio_open(struct uio_backend *ub, const char *device)
+{
+    unsigned long offset = uio_map_offset(device);
+
+    memset(ub, 0, sizeof(*ub));
+    if ((ub->fd = open(device, O_RDWR)) < 0)
+        FAIL("Error: can't open UIO device\n");
+
+    // Map 0 of a UIO device is at mmap offset 0, MAP_POPULATE as in the devmem engine
+    ub->page = mmap(0, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ub->fd, 0);
+    if (ub->page == MAP_FAILED)
+        FAIL("Error: can't map UIO registers\n");
+
+    ub->name = "uio";
+    ub->regs = (volatile uint32_t *)((uint8_t *)ub->page + offset);
+    ub->channel = (offset >> 4) & 3;
+    ub->event_size = sizeof(uint32_t);
+    ub->irq_enable = uio_irq_enable;
+    ub->close = uio_close;
+}
+
+// Same effect as the kernel's irqcontrol, straight on the register page
+void sim_irq_enable(struct uio_backend *ub, int on)
+{
+    uint32_t int_en = reg_read(ub, PWM_INT_EN_OFFSET(ub->channel));
+
+    if (on)
+        int_en |= PWM_CH_INT(ub->channel);
+    else
+        int_en &= ~PWM_CH_INT(ub->channel);
+    reg_write(ub, PWM_INT_EN_OFFSET(ub->channel), int_en);
+}
+
+/*
+    The simulated channel: once a oneshot burst is enabled, hold it for
+    count periods, record it with its start and end time, stop the channel
+    and raise the interrupt. The interrupt is acked at once, as the kernel
+    handler does. A burst starts when the engine armed it, as it would on
+    the block, not when the poll below happened to see it. It polls and
+    times bursts by spinning, yielding so it also works on a single core,
+    since sleeping would add the timer slack to every burst and gap.
+*/
+void *sim_channel(void *arg)
+{
+    struct uio_backend *ub = arg;
+    uint32_t ctrl, period, count;
+    uint64_t one = 1, start, end;
+
+    while (!ub->stop)
+    {
+        ctrl = reg_read(ub, PWM_CTRL_OFFSET);
+        if ((ctrl & (PWM_ENABLE | PWM_CONTINUOUS)) != PWM_ENABLE)
+        {
+            sched_yield();
+            continue;
+        }
+        __sync_synchronize();
+        start = ub->armed_ns;
+
+        period = reg_read(ub, PWM_PERIOD_OFFSET);
+        count = ((ctrl & PWM_ONESHOT_COUNT_MASK) >> PWM_ONESHOT_COUNT_SHIFT) + 1;
+        end = start + (uint64_t)count * period * PWM_PRESCALER * 1000000000ULL / ub->clk_hz;
+        if (ub->trace_len < ub->trace_cap)
+        {
+            ub->trace[ub->trace_len].ctrl = ctrl;
+            ub->trace[ub->trace_len].period = period;
+            ub->trace[ub->trace_len].duty = reg_read(ub, PWM_DUTY_OFFSET);
+            ub->trace[ub->trace_len].count = count;
+            ub->trace[ub->trace_len].start_ns = start;
+            ub->trace[ub->trace_len].end_ns = end;
+            ub->trace_len++;
+        }
+
+        while (now_ns() < end)
+            sched_yield();
+
+        reg_write(ub, PWM_CTRL_OFFSET, reg_read(ub, PWM_CTRL_OFFSET) & ~PWM_ENABLE);
+        if (reg_read(ub, PWM_INT_EN_OFFSET(ub->channel)) & PWM_CH_INT(ub->channel))
+        {
+            if (write(ub->fd, &one, sizeof(one)) != sizeof(one))
+                perror("[LIGHT] sim: eventfd");
+        }
+    }
+
+    return NULL;
+}
+
+void sim_close(struct uio_backend *ub)
+{
+    ub->stop = 1;
+    pthread_join(ub->thread, NULL);
+    munmap(ub->page, PAGE_SIZE);
+    close(ub->fd);
+    free(ub->trace);
+}
+
+void sim_open(struct uio_backend *ub, uint32_t clk_hz, size_t trace_cap)
+{
+    int fd;
+
+    memset(ub, 0, sizeof(*ub));
+    if ((fd = memfd_create("pwm-uio-regs", MFD_CLOEXEC)) < 0)
+        FAIL("Error: memfd_create failed\n");
+    if (ftruncate(fd, PAGE_SIZE) < 0)
+        FAIL("Error: can't size simulated register page\n");
+    ub->page = mmap(0, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, 0);
+    close(fd);
+    if (ub->page == MAP_FAILED)
+        FAIL("Error: can't map simulated register page\n");
+
+    // Lay the page out like the RK3568 PWM block, driving channel 2
+    ub->name = "sim";
+    ub->channel = 2;
+    ub->regs = (volatile uint32_t *)((uint8_t *)ub->page + 0x20);
+    if ((ub->fd = eventfd(0, EFD_CLOEXEC)) < 0)
+        FAIL("Error: eventfd failed\n");
+    ub->event_size = sizeof(uint64_t);
+    ub->irq_enable = sim_irq_enable;
+    ub->close = sim_close;
+    ub->clk_hz = clk_hz;
+    ub->trace_cap = trace_cap;
+    if ((ub->trace = calloc(trace_cap, sizeof(struct burst))) == NULL)
+        FAIL("Error: can't allocate burst trace\n");
+    if (pthread_create(&ub->thread, NULL, sim_channel, ub) != 0)
+        FAIL("Error: can't start simulated channel\n");
+}
+
+// ----- REAL-TIME -----
+// Touch the stack we'll use so no page faults happen once real-time
+__attribute__((noinline)) void prefault_stack(void)
+{
+    volatile unsigned char stack[PREFAULT_STACK];
+
+    memset((void *)stack, 0, sizeof(stack));
+}
+
+void rt_setup(int cpu, int priority)
+{
+    struct sched_param param = { .sched_priority = priority };
+    cpu_set_t cpus;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        perror("[LIGHT] WARNING: mlockall");
+    prefault_stack();
+
+    if (cpu >= 0)
+    {
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+            perror("[LIGHT] WARNING: sched_setaffinity");
+    }
+
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+        perror("[LIGHT] WARNING: SCHED_FIFO");
+}
+
+// ----- PWM -----
+uint32_t ns_to_ticks(uint32_t ns, uint32_t clk_hz)
+{
+    return ((uint64_t)clk_hz * ns + PWM_PRESCALER * 500000000ULL) / (PWM_PRESCALER * 1000000000ULL);
+}
+
+uint32_t ticks_to_ns(uint32_t ticks, uint32_t clk_hz)
+{
+    return ((uint64_t)ticks * PWM_PRESCALER * 1000000000ULL + clk_hz / 2) / clk_hz;
+}
+
+// Time the line is high for one period of a burst, from its ctrl word
+uint32_t burst_high_ns(const struct burst *b, uint32_t clk_hz)
+{
+    if (b->ctrl & PWM_DUTY_POSITIVE)
+        return ticks_to_ns(b->duty, clk_hz);
+    return ticks_to_ns(b->period - b->duty, clk_hz);
+}
+
+// Left aligned, positive duty, stopped; returns the base control word
+uint32_t pwm_configure(struct uio_backend *ub, uint32_t period)
+{
+    uint32_t ctrl = reg_read(ub, PWM_CTRL_OFFSET);
+
+    ctrl &= ~(PWM_ENABLE | PWM_CONTINUOUS | PWM_POLARITY_MASK | PWM_OUTPUT_CENTER |
+              PWM_LOCK_EN | PWM_ONESHOT_COUNT_MASK);
+    reg_write(ub, PWM_CTRL_OFFSET, ctrl);
+
+    ctrl |= PWM_DUTY_POSITIVE | PWM_INACTIVE_NEGATIVE | PWM_OUTPUT_LEFT | PWM_LP_DISABLE;
+    reg_write(ub, PWM_PERIOD_OFFSET, period);
+    reg_write(ub, PWM_DUTY_OFFSET, 0);
+    reg_write(ub, PWM_CTRL_OFFSET, ctrl);
+
+#if DEBUG
+    printf("PWM%d period %u ctrl 0x%08x\n", ub->channel, period, ctrl);
+#endif
+    return ctrl;
+}
+
+/*
+    Send one frame. Each run of identical duty words, up to the oneshot
+    counter's 256, is loaded as one burst; the channel stops when it is
+    done and interrupts, and we sleep in the UIO read until then.
+
+    The line idles low between bursts. Below the reset time that only
+    stretches a low period, but a gap of SK6812_RST latches the strip on
+    a partial frame. Each burst is checked against the end of the last
+    one before it is armed: past BURST_GAP_NS the frame is abandoned, the
+    strip left to latch what it got, and the frame sent again from the
+    start. Returns the bursts sent and adds the restarts to *aborts,
+    -ETIMEDOUT if an interrupt never came, or -EAGAIN if the frame never
+    got through.
+*/
+int send_frame(struct uio_backend *ub, uint32_t ctrl, const uint32_t *duty, size_t len, int *aborts)
+{
+    struct timespec rst = { 0, 2 * SK6812_RST };
+    uint64_t period_ns = ticks_to_ns(reg_read(ub, PWM_PERIOD_OFFSET), ub->clk_hz);
+    uint64_t end = 0, now;
+    size_t pos = 0, run;
+    int bursts = 0, retries = 0;
+    uint32_t burst;
+
+    ub->irq_enable(ub, 1);
+    while (pos < len)
+    {
+        for (run = 1; pos + run < len && run < PWM_ONESHOT_COUNT_MAX && duty[pos + run] == duty[pos]; ++run)
+            ;
+
+        burst = ctrl | (uint32_t)(run - 1) << PWM_ONESHOT_COUNT_SHIFT;
+        reg_write(ub, PWM_CTRL_OFFSET, burst);
+        reg_write(ub, PWM_DUTY_OFFSET, duty[pos]);
+        __sync_synchronize();
+
+        now = now_ns();
+        if (pos > 0 && now - end >= BURST_GAP_NS)
+        {
+            // Too late to continue this frame: latch it and start over
+            reg_write(ub, PWM_CTRL_OFFSET, ctrl);
+            nanosleep(&rst, NULL);
+            (*aborts)++;
+            if (++retries > FRAME_RETRIES)
+            {
+                ub->irq_enable(ub, 0);
+                return -EAGAIN;
+            }
+            pos = 0;
+            continue;
+        }
+        ub->armed_ns = now;
+        __sync_synchronize();
+        reg_write(ub, PWM_CTRL_OFFSET, burst | PWM_ENABLE);
+        end = now + run * period_ns;
+
+        if (irq_wait(ub) < 0)
+        {
+            reg_write(ub, PWM_CTRL_OFFSET, ctrl);
+            ub->irq_enable(ub, 0);
+            return -ETIMEDOUT;
+        }
+        pos += run;
+        bursts++;
+    }
+    ub->irq_enable(ub, 0);
+
+    // The channel is stopped and the line idles low: that is the reset
+    nanosleep(&rst, NULL);
+
+    return bursts;
+}
+
+// ----- PROGRAM -----
+int main(int argc, char **argv)
+{
+    struct uio_backend ub;
+    const char *device = "/dev/uio0";
+    int sim = 0, cpu = -1, priority = RT_PRIORITY, leds = LEDS, frames = 1;
+    uint32_t clk_hz = PWM_CLK_HZ, d0, d1, rgb, ctrl;
+    uint8_t *pixels;
+    uint32_t *duty;
+    size_t len;
+    int opt, bursts = 0, aborts = 0, ret = 0;
+
+    while ((opt = getopt(argc, argv, "su:c:p:r:n:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': sim = 1; break;
+        case 'u': device = optarg; break;
+        case 'c': cpu = atoi(optarg); break;
+        case 'p': priority = atoi(optarg); break;
+        case 'r': clk_hz = strtoul(optarg, NULL, 0); break;
+        case 'n': leds = atoi(optarg); break;
+        case 'f': frames = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-s] [-u /dev/uioN] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || leds <= 0 || frames <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-s] [-u /dev/uioN] [-c cpu] [-p prio] [-r clk_hz] [-n leds] [-f frames] RRGGBB\n", argv[0]);
+        return 1;
+    }
+    rgb = strtoul(argv[optind], NULL, 16);
+
+    /* FILL AND ENCODE THE FRAME, the same way the kernel driver does */
+    len = (size_t)leds * SK6812_LED_BITS;
+    pixels = malloc(leds * 3);
+    duty = malloc(len * sizeof(uint32_t));
+    if (pixels == NULL || duty == NULL)
+        FAIL("[LIGHT] ERROR: Failed to allocate frame");
+    for (int i = 0; i < leds; ++i)
+    {
+        pixels[i * 3 + 0] = rgb >> 16;
+        pixels[i * 3 + 1] = rgb >> 8;
+        pixels[i * 3 + 2] = rgb;
+    }
+    // Positive duty polarity: the duty word is the high time of the bit
+    d0 = ns_to_ticks(SK6812_T0H, clk_hz);
+    d1 = ns_to_ticks(SK6812_T1H, clk_hz);
+    sk6812_encode_duty(pixels, leds, d0, d1, duty);
+
+    if (sim)
+        sim_open(&ub, clk_hz, len * frames * (FRAME_RETRIES + 1));
+    else
+        uio_open(&ub, device);
+    fprintf(stdout, "[LIGHT] %s device, channel %d, %d LEDs, PWM clock %u Hz\n", ub.name, ub.channel, leds, clk_hz);
+
+    /* GO REAL-TIME, everything is allocated and mapped by now */
+    rt_setup(cpu, priority);
+
+    ctrl = pwm_configure(&ub, ns_to_ticks(SK6812_FPWM, clk_hz));
+
+    for (int f = 0; f < frames && ret == 0; ++f)
+    {
+        int n = send_frame(&ub, ctrl, duty, len, &aborts);
+
+        if (n < 0)
+        {
+            if (n == -EAGAIN)
+                printf("[LIGHT] ERROR: frame %d restarted %d times, bursts are re-armed too late for this strip\n", f, FRAME_RETRIES);
+            else
+                printf("[LIGHT] ERROR: no interrupt from the PWM channel, is the UIO binding loaded?\n");
+            ret = 1;
+            break;
+        }
+        bursts += n;
+    }
+
+    /*
+        The simulated channel recorded every burst with its start and end.
+        Expand them and check what each period puts on the line, not just
+        that it matches our own encoding: every bit's high time against the
+        datasheet, and every idle gap between bursts. A gap of the reset
+        time latches the strip, so it has to fall on a frame boundary or be
+        one of the restarts send_frame reported; anything else is a frame
+        the strip took half of without anyone noticing.
+    */
+    if (sim && ret == 0)
+    {
+        size_t k = 0, total = 0;
+        int done = 0, partial = 0;
+
+        for (size_t b = 0; b < ub.trace_len && ret == 0; ++b)
+        {
+            uint32_t high = burst_high_ns(&ub.trace[b], clk_hz);
+
+            if (b > 0 && ub.trace[b].start_ns - ub.trace[b - 1].end_ns >= SK6812_RST)
+            {
+                if (k == len)
+                    done++;
+                else
+                    partial++;
+                k = 0;
+            }
+            for (uint32_t c = 0; c < ub.trace[b].count; ++c, ++k, ++total)
+            {
+                uint32_t want = sk6812_wire_bit(pixels, k % len) ? SK6812_T1H : SK6812_T0H;
+
+                if (k >= len || high + SK6812_TOL < want || high > want + SK6812_TOL)
+                {
+                    printf("[LIGHT] sim: burst %zu bit %zu high for %u ns, want %u\n", b, k, high, want);
+                    ret = 1;
+                    break;
+                }
+            }
+        }
+        // The trace ends with the final reset
+        if (ret == 0 && k == len)
+            done++;
+        else if (ret == 0 && k != 0)
+            partial++;
+
+        if (ret == 0 && partial != aborts)
+        {
+            printf("[LIGHT] sim: strip latched %d partial frame(s), %d restart(s) reported\n", partial, aborts);
+            ret = 1;
+        }
+        if (ret == 0 && done != frames)
+        {
+            printf("[LIGHT] sim: %d of %d frames latched complete\n", done, frames);
+            ret = 1;
+        }
+        if (ret == 0)
+            printf("[LIGHT] sim: %d frame(s) in %d bursts, %d restart(s), all %zu bits within %d ns of T0H/T1H\n",
+                   frames, bursts, aborts, total, SK6812_TOL);
+    }
+
+    ub.close(&ub);
+    free(pixels);
+    free(duty);
+    return ret;
+}